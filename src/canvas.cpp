@@ -0,0 +1,343 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "canvas.h"
+#include "utils.h"
+#include <gst/gst.h>
+#include <opencv2/imgproc.hpp>
+
+GST_DEBUG_CATEGORY(canvas_t_debug);
+#define GST_CAT_DEFAULT canvas_t_debug
+
+// above this, dirty rects are merged into a single bounding rect
+#define MAX_DIRTY_RECTS (16)
+// rects closer than this are merged
+#define DIRTY_RECT_MERGE_MARGIN (16)
+
+
+canvas_t::canvas_t(int width, int height) :
+  width_(width),
+  height_(height)
+{
+  GST_DEBUG_CATEGORY_INIT(canvas_t_debug, "canvas_t", 0, "i.MX NN Inference demo canvas class");
+  dirty_rects_.reserve(MAX_DIRTY_RECTS);
+}
+
+canvas_t::~canvas_t()
+{
+}
+
+void
+canvas_t::add_dirty_rect(cv::Rect rect)
+{
+  rect &= cv::Rect(0, 0, width_, height_);
+  if (rect.empty()) {
+    return;
+  }
+
+  cv::Rect near(
+    rect.x - DIRTY_RECT_MERGE_MARGIN,
+    rect.y - DIRTY_RECT_MERGE_MARGIN,
+    rect.width + 2 * DIRTY_RECT_MERGE_MARGIN,
+    rect.height + 2 * DIRTY_RECT_MERGE_MARGIN);
+  for (size_t i = 0; i < dirty_rects_.size(); i++) {
+    if (!(dirty_rects_[i] & near).empty()) {
+      dirty_rects_[i] |= rect;
+      return;
+    }
+  }
+
+  if (dirty_rects_.size() < MAX_DIRTY_RECTS) {
+    dirty_rects_.push_back(rect);
+    return;
+  }
+
+  // too many rects, fall back to a single bounding rect
+  for (size_t i = 1; i < dirty_rects_.size(); i++) {
+    dirty_rects_[0] |= dirty_rects_[i];
+  }
+  dirty_rects_.resize(1);
+  dirty_rects_[0] |= rect;
+}
+
+void
+canvas_t::add_dirty_rectangle(
+  cv::Point pt1,
+  cv::Point pt2,
+  int thickness)
+{
+  int r = std::max(thickness, 0) / 2 + 1;
+  add_dirty_rect(cv::Rect(
+    std::min(pt1.x, pt2.x) - r,
+    std::min(pt1.y, pt2.y) - r,
+    std::abs(pt2.x - pt1.x) + 2 * r + 1,
+    std::abs(pt2.y - pt1.y) + 2 * r + 1));
+}
+
+void
+canvas_t::add_dirty_line(
+  cv::Point pt1,
+  cv::Point pt2,
+  int thickness)
+{
+  add_dirty_rectangle(pt1, pt2, thickness);
+}
+
+void
+canvas_t::add_dirty_circle(
+  cv::Point center,
+  int radius,
+  int thickness)
+{
+  int r = radius + std::max(thickness, 0) / 2 + 1;
+  add_dirty_rect(cv::Rect(center.x - r, center.y - r, 2 * r + 1, 2 * r + 1));
+}
+
+
+mat_canvas_t::mat_canvas_t(cv::Mat& frame, bool has_alpha) :
+  canvas_t(frame.cols, frame.rows),
+  frame_(frame),
+  has_alpha_(has_alpha)
+{
+}
+
+mat_canvas_t::~mat_canvas_t()
+{
+}
+
+void
+mat_canvas_t::rectangle(
+  cv::Point pt1,
+  cv::Point pt2,
+  const cv::Scalar& color,
+  int thickness)
+{
+  cv::rectangle(frame_, pt1, pt2, to_color(color), thickness);
+  add_dirty_rectangle(pt1, pt2, thickness);
+}
+
+void
+mat_canvas_t::line(
+  cv::Point pt1,
+  cv::Point pt2,
+  const cv::Scalar& color,
+  int thickness)
+{
+  cv::line(frame_, pt1, pt2, to_color(color), thickness);
+  add_dirty_line(pt1, pt2, thickness);
+}
+
+void
+mat_canvas_t::circle(
+  cv::Point center,
+  int radius,
+  const cv::Scalar& color,
+  int thickness)
+{
+  cv::circle(frame_, center, radius, to_color(color), thickness);
+  add_dirty_circle(center, radius, thickness);
+}
+
+void
+mat_canvas_t::blend_mask(
+  const cv::Mat& mask,
+  cv::Point pos,
+  const cv::Scalar& color)
+{
+  if (frame_.type() != CV_8UC4) {
+    GST_WARNING("Not supported frame type %d", frame_.type());
+    return;
+  }
+
+  cv::Rect rect = cv::Rect(pos, mask.size()) & cv::Rect(0, 0, frame_.cols, frame_.rows);
+  if (rect.empty()) {
+    return;
+  }
+
+  cv::Scalar c = to_color(color);
+  uint8_t bgrx[4];
+  for (int i = 0; i < 4; i++) {
+    bgrx[i] = cv::saturate_cast<uint8_t>(c[i]);
+  }
+  for (int y = 0; y < rect.height; y++) {
+    uint8_t *dst = frame_.ptr<uint8_t>(rect.y + y) + rect.x * 4;
+    const uint8_t *src = mask.ptr<uint8_t>(rect.y - pos.y + y) + (rect.x - pos.x);
+    utils::blend_mask_bgrx_row(dst, src, rect.width, bgrx);
+  }
+  add_dirty_rect(rect);
+}
+
+
+yuv_canvas_t::yuv_canvas_t(
+  int width,
+  int height,
+  bool nv12,
+  uint8_t *plane[3],
+  int stride[3]) :
+  canvas_t(width, height),
+  nv12_(nv12)
+{
+  int chroma_width = (width + 1) / 2;
+  int chroma_height = (height + 1) / 2;
+  y_ = cv::Mat(height, width, CV_8UC1, plane[0], stride[0]);
+  if (nv12_) {
+    uv_ = cv::Mat(chroma_height, chroma_width, CV_8UC2, plane[1], stride[1]);
+  } else {
+    u_ = cv::Mat(chroma_height, chroma_width, CV_8UC1, plane[1], stride[1]);
+    v_ = cv::Mat(chroma_height, chroma_width, CV_8UC1, plane[2], stride[2]);
+  }
+}
+
+yuv_canvas_t::~yuv_canvas_t()
+{
+}
+
+yuv_canvas_t::yuv_t
+yuv_canvas_t::to_yuv(const cv::Scalar& color)
+{
+  // BT.601 limited range, color is (B, G, R)
+  double b = color[0];
+  double g = color[1];
+  double r = color[2];
+  yuv_t yuv;
+  yuv.y_ = cv::saturate_cast<uint8_t>(16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255);
+  yuv.u_ = cv::saturate_cast<uint8_t>(128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255);
+  yuv.v_ = cv::saturate_cast<uint8_t>(128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255);
+  return yuv;
+}
+
+void
+yuv_canvas_t::rectangle(
+  cv::Point pt1,
+  cv::Point pt2,
+  const cv::Scalar& color,
+  int thickness)
+{
+  yuv_t yuv = to_yuv(color);
+  cv::rectangle(y_, pt1, pt2, cv::Scalar(yuv.y_), thickness);
+  if (nv12_) {
+    cv::rectangle(uv_, half(pt1), half(pt2), cv::Scalar(yuv.u_, yuv.v_), half_thickness(thickness));
+  } else {
+    cv::rectangle(u_, half(pt1), half(pt2), cv::Scalar(yuv.u_), half_thickness(thickness));
+    cv::rectangle(v_, half(pt1), half(pt2), cv::Scalar(yuv.v_), half_thickness(thickness));
+  }
+  add_dirty_rectangle(pt1, pt2, thickness);
+}
+
+void
+yuv_canvas_t::line(
+  cv::Point pt1,
+  cv::Point pt2,
+  const cv::Scalar& color,
+  int thickness)
+{
+  yuv_t yuv = to_yuv(color);
+  cv::line(y_, pt1, pt2, cv::Scalar(yuv.y_), thickness);
+  if (nv12_) {
+    cv::line(uv_, half(pt1), half(pt2), cv::Scalar(yuv.u_, yuv.v_), half_thickness(thickness));
+  } else {
+    cv::line(u_, half(pt1), half(pt2), cv::Scalar(yuv.u_), half_thickness(thickness));
+    cv::line(v_, half(pt1), half(pt2), cv::Scalar(yuv.v_), half_thickness(thickness));
+  }
+  add_dirty_line(pt1, pt2, thickness);
+}
+
+void
+yuv_canvas_t::circle(
+  cv::Point center,
+  int radius,
+  const cv::Scalar& color,
+  int thickness)
+{
+  yuv_t yuv = to_yuv(color);
+  cv::circle(y_, center, radius, cv::Scalar(yuv.y_), thickness);
+  if (nv12_) {
+    cv::circle(uv_, half(center), std::max(1, radius / 2), cv::Scalar(yuv.u_, yuv.v_), half_thickness(thickness));
+  } else {
+    cv::circle(u_, half(center), std::max(1, radius / 2), cv::Scalar(yuv.u_), half_thickness(thickness));
+    cv::circle(v_, half(center), std::max(1, radius / 2), cv::Scalar(yuv.v_), half_thickness(thickness));
+  }
+  add_dirty_circle(center, radius, thickness);
+}
+
+void
+yuv_canvas_t::blend_mask(
+  const cv::Mat& mask,
+  cv::Point pos,
+  const cv::Scalar& color)
+{
+  cv::Rect rect = cv::Rect(pos, mask.size()) & cv::Rect(0, 0, width_, height_);
+  if (rect.empty()) {
+    return;
+  }
+
+  yuv_t yuv = to_yuv(color);
+  for (int y = 0; y < rect.height; y++) {
+    utils::blend_mask_plane_row(
+      y_.ptr<uint8_t>(rect.y + y) + rect.x,
+      mask.ptr<uint8_t>(rect.y - pos.y + y) + (rect.x - pos.x),
+      rect.width,
+      yuv.y_);
+  }
+
+  // chroma sites covering rect, the mask is averaged over each 2x2 site
+  // one row at a time, mask pixels outside rect count as transparent
+  int x1 = rect.x + rect.width;
+  int y1 = rect.y + rect.height;
+  cv::Rect chroma_rect(rect.x / 2, rect.y / 2, (x1 + 1) / 2 - rect.x / 2, (y1 + 1) / 2 - rect.y / 2);
+  chroma_rect &= cv::Rect(0, 0, (nv12_ ? uv_ : u_).cols, (nv12_ ? uv_ : u_).rows);
+  chroma_row_.resize(chroma_rect.width);
+  uint8_t uv[2] = { yuv.u_, yuv.v_ };
+  for (int y = 0; y < chroma_rect.height; y++) {
+    for (int x = 0; x < chroma_rect.width; x++) {
+      int sum = 0;
+      for (int dy = 0; dy < 2; dy++) {
+        int my = 2 * (chroma_rect.y + y) + dy;
+        if ((my < rect.y) || (my >= y1)) {
+          continue;
+        }
+        const uint8_t *row = mask.ptr<uint8_t>(my - pos.y);
+        for (int dx = 0; dx < 2; dx++) {
+          int mx = 2 * (chroma_rect.x + x) + dx;
+          if ((mx >= rect.x) && (mx < x1)) {
+            sum += row[mx - pos.x];
+          }
+        }
+      }
+      chroma_row_[x] = (uint8_t)((sum + 2) >> 2);
+    }
+    const uint8_t *m = chroma_row_.data();
+    if (nv12_) {
+      utils::blend_mask_uv_row(
+        uv_.ptr<uint8_t>(chroma_rect.y + y) + chroma_rect.x * 2, m, chroma_rect.width, uv);
+    } else {
+      utils::blend_mask_plane_row(
+        u_.ptr<uint8_t>(chroma_rect.y + y) + chroma_rect.x, m, chroma_rect.width, yuv.u_);
+      utils::blend_mask_plane_row(
+        v_.ptr<uint8_t>(chroma_rect.y + y) + chroma_rect.x, m, chroma_rect.width, yuv.v_);
+    }
+  }
+
+  add_dirty_rect(rect);
+}
@@ -0,0 +1,211 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef canvas_h
+#define canvas_h
+
+#include <algorithm>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Drawing target for results and stats.
+// Colors are given as cv::Scalar(B, G, R). Every primitive records the
+// bounding rect it touched, so callers can limit clearing and compositing
+// to the dirty area.
+class canvas_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  canvas_t(int width, int height);
+  virtual ~canvas_t();
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // thickness < 0 (cv::FILLED) fills the shape
+  virtual void rectangle(
+    cv::Point pt1,
+    cv::Point pt2,
+    const cv::Scalar& color,
+    int thickness = 1) = 0;
+
+  virtual void line(
+    cv::Point pt1,
+    cv::Point pt2,
+    const cv::Scalar& color,
+    int thickness = 1) = 0;
+
+  virtual void circle(
+    cv::Point center,
+    int radius,
+    const cv::Scalar& color,
+    int thickness = 1) = 0;
+
+  // blend color through an 8bit alpha mask placed at pos
+  virtual void blend_mask(
+    const cv::Mat& mask,
+    cv::Point pos,
+    const cv::Scalar& color) = 0;
+
+  const std::vector<cv::Rect>& get_dirty_rects() const { return dirty_rects_; }
+  void clear_dirty_rects() { dirty_rects_.clear(); }
+
+protected:
+
+  void add_dirty_rect(cv::Rect rect);
+  // bounding rects of the cv::rectangle/line/circle primitives
+  void add_dirty_rectangle(cv::Point pt1, cv::Point pt2, int thickness);
+  void add_dirty_line(cv::Point pt1, cv::Point pt2, int thickness);
+  void add_dirty_circle(cv::Point center, int radius, int thickness);
+
+  int width_;
+  int height_;
+
+private:
+
+  std::vector<cv::Rect> dirty_rects_;
+
+  // unused
+  canvas_t(const canvas_t&);
+  canvas_t& operator=(const canvas_t&);
+
+};
+
+// canvas over a 32bit BGRx or BGRA cv::Mat
+class mat_canvas_t : public canvas_t
+{
+public:
+
+  // with has_alpha, everything is drawn opaque (alpha = 255)
+  mat_canvas_t(cv::Mat& frame, bool has_alpha = false);
+  virtual ~mat_canvas_t();
+
+  virtual void rectangle(
+    cv::Point pt1,
+    cv::Point pt2,
+    const cv::Scalar& color,
+    int thickness = 1);
+
+  virtual void line(
+    cv::Point pt1,
+    cv::Point pt2,
+    const cv::Scalar& color,
+    int thickness = 1);
+
+  virtual void circle(
+    cv::Point center,
+    int radius,
+    const cv::Scalar& color,
+    int thickness = 1);
+
+  virtual void blend_mask(
+    const cv::Mat& mask,
+    cv::Point pos,
+    const cv::Scalar& color);
+
+  cv::Mat& mat() { return frame_; }
+
+  // retarget to a frame of the same size, e.g. after a remap
+  void reset(cv::Mat& frame)
+  {
+    frame_ = frame;
+    clear_dirty_rects();
+  }
+
+private:
+
+  cv::Scalar to_color(const cv::Scalar& color) const
+  {
+    return cv::Scalar(color[0], color[1], color[2], has_alpha_ ? 255 : color[3]);
+  }
+
+  cv::Mat frame_;
+  bool has_alpha_;
+
+};
+
+// canvas over NV12 or I420 planes.
+// Colors are converted to BT.601 limited range YUV once per primitive, then
+// each primitive is rasterized into the Y plane at full resolution and into
+// the chroma plane(s) at half resolution.
+class yuv_canvas_t : public canvas_t
+{
+public:
+
+  // plane[i] and stride[i] as in GstVideoFrame, NV12 or I420 only
+  yuv_canvas_t(
+    int width,
+    int height,
+    bool nv12,
+    uint8_t *plane[3],
+    int stride[3]);
+  virtual ~yuv_canvas_t();
+
+  virtual void rectangle(
+    cv::Point pt1,
+    cv::Point pt2,
+    const cv::Scalar& color,
+    int thickness = 1);
+
+  virtual void line(
+    cv::Point pt1,
+    cv::Point pt2,
+    const cv::Scalar& color,
+    int thickness = 1);
+
+  virtual void circle(
+    cv::Point center,
+    int radius,
+    const cv::Scalar& color,
+    int thickness = 1);
+
+  virtual void blend_mask(
+    const cv::Mat& mask,
+    cv::Point pos,
+    const cv::Scalar& color);
+
+private:
+
+  struct yuv_t {
+    uint8_t y_;
+    uint8_t u_;
+    uint8_t v_;
+  };
+
+  static yuv_t to_yuv(const cv::Scalar& color);
+  static cv::Point half(cv::Point pt) { return cv::Point(pt.x >> 1, pt.y >> 1); }
+  static int half_thickness(int thickness) { return (thickness < 0) ? thickness : std::max(1, thickness / 2); }
+
+  bool nv12_;
+  cv::Mat y_;
+  cv::Mat uv_;  // NV12, CV_8UC2
+  cv::Mat u_;   // I420
+  cv::Mat v_;   // I420
+  // one row of the subsampled mask, reused across calls
+  std::vector<uint8_t> chroma_row_;
+
+};
+
+#endif
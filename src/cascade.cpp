@@ -0,0 +1,267 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "cascade.h"
+#include <algorithm>
+#include <chrono>
+
+GST_DEBUG_CATEGORY(cascade_t_debug);
+#define GST_CAT_DEFAULT cascade_t_debug
+
+// crops are grown by this fraction of the box on each side, so the whole
+// person is in the secondary model input
+#define CROP_MARGIN (0.1f)
+// smaller crops carry too few pixels for the secondary model
+#define CROP_MIN_SIZE (16)
+
+
+cascade_t::cascade_t()
+{
+  GST_DEBUG_CATEGORY_INIT(cascade_t_debug, "cascade_t", 0, "i.MX NN Inference demo detector and secondary model cascade class");
+  GST_TRACE("%s", __func__);
+}
+
+cascade_t::~cascade_t()
+{
+  GST_TRACE("%s", __func__);
+
+  for (size_t i = 0; i < crop_bufs_.size(); i++) {
+    g2d_free(crop_bufs_[i]);
+  }
+}
+
+int cascade_t::init(
+  const std::string& detector_model,
+  const std::string& label,
+  const std::string& secondary_model,
+  int use_nnapi,
+  int num_threads)
+{
+  GST_TRACE("%s", __func__);
+
+  int ret = detector_.init(detector_model, use_nnapi, num_threads);
+  if (ret == OK) {
+    ret = detector_.load_labels(label);
+  }
+  if (ret != OK) {
+    GST_ERROR("Failed to init detector %s", detector_model.c_str());
+    return ERROR;
+  }
+  ret = secondary_.init(secondary_model, use_nnapi, num_threads);
+  // one pose per crop, the crops are not stable enough to track
+  secondary_.set_tracking(false);
+  if (ret != OK) {
+    GST_ERROR("Failed to init secondary model %s", secondary_model.c_str());
+    return ERROR;
+  }
+  // secondary input size and layout, for the crop buffers
+  return secondary_.setup_g2d();
+}
+
+void cascade_t::set_max_crops(int max_crops)
+{
+  max_crops_ = std::max(0, std::min(max_crops, POSE_NUM_POSE_MAX));
+}
+
+int cascade_t::set_num_threads(int num_threads)
+{
+  int ret = detector_.set_num_threads(num_threads);
+  ret |= secondary_.set_num_threads(num_threads);
+  return ret;
+}
+
+int cascade_t::get_num_threads(void)
+{
+  return detector_.get_num_threads();
+}
+
+void cascade_t::set_thread_policy(const thread_policy_t& policy)
+{
+  detector_.set_thread_policy(policy);
+  secondary_.set_thread_policy(policy);
+}
+
+void cascade_t::set_worker_pool(const std::shared_ptr<worker_pool_t>& pool)
+{
+  detector_.set_worker_pool(pool);
+  secondary_.set_worker_pool(pool);
+}
+
+void cascade_t::select_crops(
+  int video_width,
+  int video_height,
+  std::vector<cv::Rect>& crops)
+{
+  std::vector<mobilenet_ssd_t::detection_t> detections;
+  detector_.get_detections(detections);
+
+  crops.clear();
+  for (size_t i = 0; i < detections.size(); i++) {
+    const mobilenet_ssd_t::detection_t& det = detections[i];
+    if (det.label_ != crop_label_) {
+      continue;
+    }
+    float mx = (det.xmax_ - det.xmin_) * CROP_MARGIN;
+    float my = (det.ymax_ - det.ymin_) * CROP_MARGIN;
+    int x0 = (int)(std::max(0.0f, det.xmin_ - mx) * video_width);
+    int y0 = (int)(std::max(0.0f, det.ymin_ - my) * video_height);
+    int x1 = (int)(std::min(1.0f, det.xmax_ + mx) * video_width);
+    int y1 = (int)(std::min(1.0f, det.ymax_ + my) * video_height);
+    if ((x1 - x0 >= CROP_MIN_SIZE) && (y1 - y0 >= CROP_MIN_SIZE)) {
+      crops.push_back(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+    }
+  }
+
+  // largest first, within the budget
+  std::sort(crops.begin(), crops.end(),
+    [](const cv::Rect& a, const cv::Rect& b) { return a.area() > b.area(); });
+  if ((int)crops.size() > max_crops_) {
+    crops.resize(max_crops_);
+  }
+}
+
+int cascade_t::setup_input_tensor(
+  GObject *object,
+  GstVideoInfo *vinfo,
+  Imx2DFrame *src_frame,
+  Imx2DFrame *dst_frame)
+{
+  GST_TRACE("%s", __func__);
+
+  // whole frame for the detector
+  int ret = inference_t::setup_input_tensor(object, vinfo, src_frame, dst_frame);
+  if (ret != OK) {
+    return ret;
+  }
+
+  // crops of the last detections, boxes are in output orientation
+  crops_.clear();
+  if (src_frame->rotate != IMX_2D_ROTATION_0) {
+    GST_DEBUG("no cascade crops with rotation");
+    return OK;
+  }
+  select_crops(vinfo->width, vinfo->height, crops_);
+  crops_width_ = vinfo->width;
+  crops_height_ = vinfo->height;
+
+  while (crop_bufs_.size() < crops_.size()) {
+    g2d_buf *buf = g2d_alloc(secondary_.input_frame_size(), 1);
+    if (!buf) {
+      GST_ERROR("g2d_alloc failed");
+      crops_.resize(crop_bufs_.size());
+      break;
+    }
+    crop_bufs_.push_back(buf);
+  }
+
+  // queued as one 2D job
+  for (size_t i = 0; i < crops_.size(); i++) {
+    if (secondary_.blit_input_crop(vinfo, src_frame, crops_[i], crop_bufs_[i]) != OK) {
+      crops_.resize(i);
+      break;
+    }
+  }
+  if (!crops_.empty()) {
+    g2d_finish(imx_g2d_get_thread_handle());
+  }
+  return OK;
+}
+
+int cascade_t::inference(void)
+{
+  GST_TRACE("%s", __func__);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  int ret = detector_.inference();
+  if (ret == OK) {
+    ret = detector_.parse_results();
+  }
+  if (ret != OK) {
+    return ret;
+  }
+
+  pending_poses_.n_pose_ = 0;
+  // not batched, the decoder op takes a single image
+  for (size_t i = 0; i < crops_.size(); i++) {
+    if ((secondary_.load_input_tensor((const uint8_t *)crop_bufs_[i]->buf_vaddr) != OK) ||
+        (secondary_.inference() != OK) ||
+        (secondary_.parse_results() != OK)) {
+      continue;
+    }
+
+    // crop model coordinates to frame normalized coordinates
+    pose_results poses;
+    secondary_.get_results(poses);
+    const cv::Rect& crop = crops_[i];
+    float sx = (float)crop.width / secondary_.bgrx_width_ / crops_width_;
+    float sy = (float)crop.height / secondary_.bgrx_height_ / crops_height_;
+    float ox = (float)crop.x / crops_width_;
+    float oy = (float)crop.y / crops_height_;
+    for (int n = 0; (n < poses.n_pose_) && (pending_poses_.n_pose_ < POSE_NUM_POSE_MAX); n++) {
+      pose_structure& pose = pending_poses_.pose_[pending_poses_.n_pose_++];
+      pose = poses.pose_[n];
+      for (int k = 0; k < POSE_NUM_KEYPOINTS; k++) {
+        pose.pt_[k].x_ = ox + pose.pt_[k].x_ * sx;
+        pose.pt_[k].y_ = oy + pose.pt_[k].y_ * sy;
+      }
+    }
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  inference_time_cur_ = elapsed.count();
+  return OK;
+}
+
+int cascade_t::parse_results(void)
+{
+  GST_TRACE("%s", __func__);
+
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  poses_ = pending_poses_;
+  return OK;
+}
+
+int cascade_t::draw_results(canvas_t& canvas)
+{
+  GST_TRACE("%s", __func__);
+
+  detector_.draw_results(canvas);
+
+  pose_results poses;
+  {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    poses = poses_;
+  }
+  for (int n = 0; n < poses.n_pose_; n++) {
+    for (int k = 0; k < POSE_NUM_KEYPOINTS; k++) {
+      poses.pose_[n].pt_[k].x_ *= canvas.width();
+      poses.pose_[n].pt_[k].y_ *= canvas.height();
+    }
+  }
+  float pose_threshold = 0.3;
+  float keypoint_threshold = 0.3;
+  secondary_.draw_pose(canvas, poses, pose_threshold, keypoint_threshold);
+  return OK;
+}
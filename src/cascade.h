@@ -0,0 +1,111 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef cascade_h
+#define cascade_h
+
+#include <atomic>
+#include <vector>
+#include "mobilenet_ssd.h"
+#include "posenet.h"
+
+// Detector followed by a per-crop secondary model.
+// SSD runs on the whole frame. The detections of one class from the last
+// parsed results are cropped from the source by G2D, largest first and up to
+// a per-frame budget, then PoseNet runs on each crop and the poses are
+// mapped back to the frame. The crops are staged as one 2D job but inferred
+// one at a time: the PoseNet decoder op only produces poses for batch 1.
+class cascade_t : public inference_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  cascade_t();
+  virtual ~cascade_t();
+
+  int init(
+    const std::string& detector_model,
+    const std::string& label,
+    const std::string& secondary_model,
+    int use_nnapi = 2,
+    int num_threads = 4);
+
+  // detection label id cropped for the secondary model
+  void set_crop_label(int label) { crop_label_ = label; }
+  // crops per frame, at most POSE_NUM_POSE_MAX
+  void set_max_crops(int max_crops);
+
+  virtual int setup_input_tensor(
+    GObject *object,
+    GstVideoInfo *vinfo,
+    Imx2DFrame *src_frame,
+    Imx2DFrame *dst_frame);
+  virtual bool needs_source_frame(void) const { return true; }
+  virtual int inference(void);
+  virtual int parse_results(void);
+  virtual int draw_results(canvas_t& canvas);
+
+  // the detector takes the frame staged by inference_t
+  virtual int get_input_tensor_shape(std::vector<int> *shape) { return detector_.get_input_tensor_shape(shape); }
+  virtual int get_input_tensor(uint8_t **ptr, size_t* sz) { return detector_.get_input_tensor(ptr, sz); }
+  virtual int copy_data_to_input_tensor(uint8_t *data, size_t sz) { return detector_.copy_data_to_input_tensor(data, sz); }
+
+  virtual int set_num_threads(int num_threads);
+  virtual int get_num_threads(void);
+  virtual void set_thread_policy(const thread_policy_t& policy);
+  virtual void set_worker_pool(const std::shared_ptr<worker_pool_t>& pool);
+
+private:
+
+  // largest detections of crop_label_, as source pixel rects
+  void select_crops(
+    int video_width,
+    int video_height,
+    std::vector<cv::Rect>& crops);
+
+  mobilenet_ssd_t detector_;
+  posenet_t secondary_;
+
+  std::atomic<int> crop_label_{0};
+  std::atomic<int> max_crops_{2};
+
+  // one secondary input staging buffer per crop
+  std::vector<g2d_buf *> crop_bufs_;
+  // crops queued by setup_input_tensor() for the next inference()
+  std::vector<cv::Rect> crops_;
+  int crops_width_ = 0;
+  int crops_height_ = 0;
+
+  // poses of the last inference(), normalized to the frame
+  pose_results pending_poses_ = {0};
+  // guarded by results_mutex_
+  pose_results poses_ = {0};
+
+  // unused
+  cascade_t(const cascade_t&);
+  cascade_t& operator=(const cascade_t&);
+
+};
+
+#endif
@@ -0,0 +1,206 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "classifier.h"
+#include "utils.h"
+#include <algorithm>
+
+GST_DEBUG_CATEGORY(classifier_t_debug);
+#define GST_CAT_DEFAULT classifier_t_debug
+
+#define LABEL_FONT_FACE (cv::FONT_HERSHEY_SIMPLEX)
+#define LABEL_FONT_SCALE (0.7)
+#define LABEL_THICKNESS (2)
+#define LABEL_MARGIN (10)
+
+// classes followed by the running average
+#define TRACKED_MAX (16)
+// averaged scores below this are forgotten
+#define TRACKED_SCORE_MIN (0.01f)
+
+
+classifier_t::classifier_t()
+  : top_k_(TOP_K_DEFAULT), smoothing_(SMOOTHING_DEFAULT)
+{
+  GST_DEBUG_CATEGORY_INIT(classifier_t_debug, "classifier_t", 0, "i.MX NN Inference demo TFLite classifier class");
+  GST_TRACE("%s", __func__);
+}
+
+classifier_t::~classifier_t()
+{
+  GST_TRACE("%s", __func__);
+}
+
+int classifier_t::init(
+  const std::string& model,
+  int use_nnapi,
+  int num_threads)
+{
+  GST_TRACE("%s", __func__);
+  int ret = tflite_inference_t::init(model, use_nnapi, num_threads);
+  if (ret != OK) {
+    return ret;
+  }
+  // labels are optional, unlabeled classes are drawn as "unknown"
+  text_renderer_.init(LABEL_FONT_FACE, LABEL_FONT_SCALE, LABEL_THICKNESS);
+
+  const TfLiteTensor *tensor = interpreter_->tensor(interpreter_->outputs()[0]);
+  if ((tensor->type != kTfLiteUInt8) && (tensor->type != kTfLiteInt8) && (tensor->type != kTfLiteFloat32)) {
+    GST_ERROR("Unsupported output tensor type %d", tensor->type);
+    return ERROR;
+  }
+  GST_DEBUG("output type %d, scale %f, zero point %d", tensor->type, tensor->params.scale, tensor->params.zero_point);
+  return OK;
+}
+
+int
+classifier_t::load_labels(
+  const std::string& filename)
+{
+  GST_TRACE("%s", __func__);
+  text_renderer_.init(LABEL_FONT_FACE, LABEL_FONT_SCALE, LABEL_THICKNESS);
+  return labels_.load(filename, text_renderer_);
+}
+
+void
+classifier_t::set_top_k(
+  int top_k)
+{
+  top_k_ = std::min(std::max(top_k, 1), (int)TOP_K_MAX);
+}
+
+void
+classifier_t::set_smoothing(
+  float smoothing)
+{
+  smoothing_ = std::min(std::max(smoothing, 0.01f), 1.0f);
+}
+
+float
+classifier_t::get_score(
+  const TfLiteTensor *tensor,
+  int id)
+{
+  switch (tensor->type) {
+  case kTfLiteUInt8:
+    return tensor->params.scale * (tensor->data.uint8[id] - tensor->params.zero_point);
+  case kTfLiteInt8:
+    return tensor->params.scale * (tensor->data.int8[id] - tensor->params.zero_point);
+  default:
+    return tensor->data.f[id];
+  }
+}
+
+int classifier_t::parse_results(void)
+{
+  GST_TRACE("%s", __func__);
+
+  const TfLiteTensor *tensor = interpreter_->tensor(interpreter_->outputs()[0]);
+  int num_classes = tensor->dims->data[tensor->dims->size - 1];
+
+  // quantization is monotonic, select on the raw values and only
+  // dequantize the candidates
+  int top_k = top_k_;
+  float smoothing = smoothing_;
+  int candidates[2 * TOP_K_MAX];
+  int num_candidates = 2 * top_k;
+  switch (tensor->type) {
+  case kTfLiteUInt8:
+    num_candidates = utils::top_k_u8(tensor->data.uint8, num_classes, num_candidates, candidates);
+    break;
+  case kTfLiteInt8:
+    num_candidates = utils::top_k_s8(tensor->data.int8, num_classes, num_candidates, candidates);
+    break;
+  case kTfLiteFloat32:
+    num_candidates = utils::top_k_f32(tensor->data.f, num_classes, num_candidates, candidates);
+    break;
+  default:
+    return ERROR;
+  }
+
+  // exponential average, classes already tracked are updated with their
+  // current score even when they left the candidates
+  std::vector<class_score_t>& tracked = tracked_next_;
+  tracked.clear();
+  for (size_t i = 0; i < tracked_.size(); i++) {
+    const class_score_t& prev = tracked_[i];
+    float score = smoothing * get_score(tensor, prev.id_) + (1.0f - smoothing) * prev.score_;
+    if (score >= TRACKED_SCORE_MIN) {
+      tracked.push_back({prev.id_, score});
+    }
+  }
+  for (int i = 0; i < num_candidates; i++) {
+    int id = candidates[i];
+    auto it = std::find_if(tracked_.begin(), tracked_.end(),
+      [id](const class_score_t& c) { return c.id_ == id; });
+    if (it != tracked_.end()) {
+      continue;
+    }
+    // new classes ramp up from 0, except on the first frame
+    float score = get_score(tensor, id);
+    if (!tracked_.empty()) {
+      score *= smoothing;
+    }
+    if (score >= TRACKED_SCORE_MIN) {
+      tracked.push_back({id, score});
+    }
+  }
+
+  std::sort(tracked.begin(), tracked.end(),
+    [](const class_score_t& a, const class_score_t& b) { return a.score_ > b.score_; });
+  if (tracked.size() > TRACKED_MAX) {
+    tracked.resize(TRACKED_MAX);
+  }
+  tracked_.swap(tracked);
+
+  parsed_.assign(tracked_.begin(),
+    tracked_.begin() + std::min((size_t)top_k, tracked_.size()));
+
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  results_.swap(parsed_);
+  return OK;
+}
+
+void classifier_t::get_results(std::vector<class_score_t>& results)
+{
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  results = results_;
+}
+
+int classifier_t::draw_results(canvas_t& canvas)
+{
+  GST_TRACE("%s", __func__);
+
+  // top left, stats are drawn at the bottom
+  int y = LABEL_MARGIN;
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  for (size_t i = 0; i < results_.size(); i++) {
+    const label_table_t::text_t& text = labels_.get_text(results_[i].id_, results_[i].score_);
+    const cv::Size& text_sz = text.size_;
+    canvas.rectangle(cv::Point(LABEL_MARGIN, y), cv::Point(LABEL_MARGIN + text_sz.width, y + text_sz.height + text.baseline_), cv::Scalar(255, 255, 255), cv::FILLED);
+    text_renderer_.draw(canvas, text.str_, cv::Point(LABEL_MARGIN, y + text_sz.height), cv::Scalar(0, 0, 0));
+    y += text_sz.height + text.baseline_ + LABEL_MARGIN / 2;
+  }
+  return OK;
+}
@@ -0,0 +1,100 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef classifier_h
+#define classifier_h
+
+#include <atomic>
+#include "tflite_inference.h"
+#include "label_table.h"
+
+// image classifier, single [1, num_classes] output tensor (uint8, int8
+// or float32)
+class classifier_t : public tflite_inference_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  static const int TOP_K_MAX = 5;
+  static const int TOP_K_DEFAULT = 3;
+  static constexpr float SMOOTHING_DEFAULT = 0.3f;
+
+  classifier_t();
+  virtual ~classifier_t();
+
+  int init(
+    const std::string& model,
+    int use_nnapi = 2,
+    int num_threads = 4);
+
+  int load_labels(
+    const std::string& label);
+
+  // number of labels displayed, 1 .. TOP_K_MAX
+  void set_top_k(int top_k);
+
+  // weight of the newest scores in the running average, 1.0 disables
+  // the averaging
+  void set_smoothing(float smoothing);
+
+  struct class_score_t {
+    int id_;
+    float score_;
+  };
+
+  virtual int parse_results(void);
+  virtual int draw_results(canvas_t& canvas);
+
+  // last smoothed top-k, best first
+  void get_results(std::vector<class_score_t>& results);
+
+private:
+
+  // dequantized score of one class of the output tensor
+  static float get_score(
+    const TfLiteTensor *tensor,
+    int id);
+
+  label_table_t labels_;
+  std::atomic<int> top_k_;
+  std::atomic<float> smoothing_;
+
+  // averaged scores of the recently seen classes, only touched by
+  // parse_results
+  std::vector<class_score_t> tracked_;
+  // parse_results() scratch, swapped with tracked_ and results_ so that
+  // all of them keep their capacity
+  std::vector<class_score_t> tracked_next_;
+  std::vector<class_score_t> parsed_;
+
+  // guarded by results_mutex_
+  std::vector<class_score_t> results_;
+
+  // unused
+  classifier_t(const classifier_t&);
+  classifier_t& operator=(const classifier_t&);
+
+};
+
+#endif
@@ -27,6 +27,14 @@ extern "C" {
 unsigned long phy_addr_from_fd(int dmafd);
 unsigned long phy_addr_from_vaddr(void *vaddr, int size);
 
+/* phy_addr_from_fd() through a process wide LRU cache keyed by the dmabuf
+ * inode and fd, the inode alone does not identify a dmabuf on old kernels */
+unsigned long phy_addr_from_fd_cached(int dmafd);
+/* drop the entries of dmafd, or all entries if dmafd < 0. Must be called
+ * before a cached fd is closed, as the fd can be reused for another buffer */
+void phy_addr_cache_invalidate(int dmafd);
+void phy_addr_cache_get_stats(unsigned long *hits, unsigned long *misses);
+
 
 #ifdef __cplusplus
 }
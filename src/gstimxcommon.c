@@ -21,8 +21,10 @@
 #include "gstimxcommon.h"
 #include "gstimx.h"
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <linux/version.h>
 #include <linux/dma-buf.h>
 #ifdef USE_ION
@@ -30,7 +32,30 @@
 #endif
 const char *dev_ion = "/dev/ion";
 
-unsigned long phy_addr_from_fd(int dmafd)
+#define PHY_ADDR_CACHE_SIZE (32)
+
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+  int fd;
+  unsigned long paddr;
+  unsigned long last_use;
+} PhyAddrCacheEntry;
+
+/* since Linux 5.3 every dmabuf has its own inode, before that they all share
+ * the anon inode and only the fd tells them apart: callers invalidate an fd
+ * when its buffer is released, see phy_addr_cache_invalidate() */
+static struct {
+  pthread_mutex_t lock;
+  PhyAddrCacheEntry entries[PHY_ADDR_CACHE_SIZE];
+  int count;
+  unsigned long clock;
+  unsigned long hits;
+  unsigned long misses;
+} phy_addr_cache = { PTHREAD_MUTEX_INITIALIZER };
+
+/* weak, tests/phy_addr_cache.c links the cache against its own */
+__attribute__((weak)) unsigned long phy_addr_from_fd(int dmafd)
 {
   int ret, fd;
 
@@ -113,3 +138,88 @@ unsigned long phy_addr_from_vaddr(void *vaddr, int size)
   return NULL;
 #endif
 }
+
+unsigned long phy_addr_from_fd_cached(int dmafd)
+{
+  struct stat st;
+  unsigned long paddr;
+  int i, victim;
+
+  if (dmafd < 0 || fstat(dmafd, &st) < 0)
+    return (unsigned long)NULL;
+
+  pthread_mutex_lock(&phy_addr_cache.lock);
+  for (i = 0; i < phy_addr_cache.count; i++) {
+    PhyAddrCacheEntry *entry = &phy_addr_cache.entries[i];
+    if (entry->fd == dmafd && entry->ino == st.st_ino && entry->dev == st.st_dev) {
+      entry->last_use = ++phy_addr_cache.clock;
+      phy_addr_cache.hits++;
+      paddr = entry->paddr;
+      pthread_mutex_unlock(&phy_addr_cache.lock);
+      return paddr;
+    }
+  }
+  phy_addr_cache.misses++;
+  pthread_mutex_unlock(&phy_addr_cache.lock);
+
+  paddr = phy_addr_from_fd(dmafd);
+  if (!paddr)
+    return paddr;
+
+  pthread_mutex_lock(&phy_addr_cache.lock);
+  /* reuse the slot of the same fd, a free slot, or the least recently used */
+  victim = -1;
+  for (i = 0; i < phy_addr_cache.count; i++) {
+    if (phy_addr_cache.entries[i].fd == dmafd) {
+      victim = i;
+      break;
+    }
+  }
+  if (victim < 0) {
+    if (phy_addr_cache.count < PHY_ADDR_CACHE_SIZE) {
+      victim = phy_addr_cache.count++;
+    } else {
+      victim = 0;
+      for (i = 1; i < phy_addr_cache.count; i++) {
+        if (phy_addr_cache.entries[i].last_use < phy_addr_cache.entries[victim].last_use)
+          victim = i;
+      }
+    }
+  }
+  phy_addr_cache.entries[victim].dev = st.st_dev;
+  phy_addr_cache.entries[victim].ino = st.st_ino;
+  phy_addr_cache.entries[victim].fd = dmafd;
+  phy_addr_cache.entries[victim].paddr = paddr;
+  phy_addr_cache.entries[victim].last_use = ++phy_addr_cache.clock;
+  pthread_mutex_unlock(&phy_addr_cache.lock);
+
+  return paddr;
+}
+
+void phy_addr_cache_invalidate(int dmafd)
+{
+  int i;
+
+  pthread_mutex_lock(&phy_addr_cache.lock);
+  if (dmafd < 0) {
+    phy_addr_cache.count = 0;
+  } else {
+    for (i = 0; i < phy_addr_cache.count; ) {
+      if (phy_addr_cache.entries[i].fd == dmafd)
+        phy_addr_cache.entries[i] = phy_addr_cache.entries[--phy_addr_cache.count];
+      else
+        i++;
+    }
+  }
+  pthread_mutex_unlock(&phy_addr_cache.lock);
+}
+
+void phy_addr_cache_get_stats(unsigned long *hits, unsigned long *misses)
+{
+  pthread_mutex_lock(&phy_addr_cache.lock);
+  if (hits)
+    *hits = phy_addr_cache.hits;
+  if (misses)
+    *misses = phy_addr_cache.misses;
+  pthread_mutex_unlock(&phy_addr_cache.lock);
+}
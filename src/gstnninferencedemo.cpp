@@ -35,10 +35,18 @@ extern "C" {
 #include "tflite_benchmark.h"
 #include "posenet.h"
 #include "mobilenet_ssd.h"
+#include "cascade.h"
+#include "classifier.h"
+#include "segmentation.h"
+#include "utils.h"
 
 #define IN_POOL_MAX_BUFFERS (30)
+/* row bands per plane used to copy non physical input frames */
+#define COPY_SLICES_PER_PLANE (4)
 
 #define PARAMS_QDATA g_quark_from_static_string("nninferencedemo-params")
+#define NO_PHYADDR_QUARK g_quark_from_static_string("nninferencedemo-no-phyaddr")
+#define DMABUF_FD_QUARK g_quark_from_static_string("nninferencedemo-dmabuf-fd")
 
 #define ROTATION_DEFAULT (IMX_2D_ROTATION_0)
 #define DEMO_MODE_DEFAULT (GstNnInferenceDemo::tflite_posenet)
@@ -46,7 +54,40 @@ extern "C" {
 #define ENABLE_INFERENCE_DEFAULT (TRUE)
 #define USE_NNAPI_DEFAULT (2)
 #define NUM_THREADS_DEFAULT (4)
+#define OVERLAY_MODE_DEFAULT (GstNnInferenceDemo::overlay_frame)
+#define QOS_SHEDDING_DEFAULT (FALSE)
+/* weight of the last QoS event in the smoothed proportion */
+#define QOS_SMOOTHING (0.25)
+/* a level is left when the proportion falls this far below its threshold */
+#define QOS_HYSTERESIS (0.1)
+/* under skip-inference, the inference interval is multiplied by this */
+#define QOS_INFERENCE_INTERVAL (2)
+#define CPU_AFFINITY_DEFAULT ""
+/* worker threads of the shared CPU pool, besides the calling thread */
+#define CPU_POOL_THREADS_DEFAULT (3)
+#define CPU_POOL_AFFINITY_DEFAULT ""
+#define SCHED_POLICY_DEFAULT (GstNnInferenceDemo::sched_other)
+#define SCHED_PRIORITY_DEFAULT (1)
+#define AUTOTUNE_THREADS_DEFAULT (FALSE)
+#define INFERENCE_MODE_DEFAULT (GstNnInferenceDemo::inference_sync)
+#define INFERENCE_INTERVAL_DEFAULT (1)
+#define REPLICAS_DEFAULT (2)
+/* infer_sink buffers kept for PTS matching */
+#define INFER_QUEUE_SIZE (4)
+/* running time matching window when the infer_sink framerate is unknown */
+#define INFER_PTS_TOLERANCE (20 * GST_MSECOND)
+#define STARTUP_DEFAULT (GstNnInferenceDemo::startup_wait)
+/* weight of the last frame in the smoothed latencies */
+#define LATENCY_SMOOTHING (0.1)
+/* re-query latency when it grows this much over the reported one */
+#define LATENCY_MARGIN (1.25)
 #define MODEL_DEFAULT ""
+#define SECONDARY_MODEL_DEFAULT ""
+/* person in the coco labels */
+#define CASCADE_LABEL_DEFAULT (0)
+#define CASCADE_MAX_CROPS_DEFAULT (2)
+#define CLASSIFIER_TOP_K_DEFAULT (classifier_t::TOP_K_DEFAULT)
+#define CLASSIFIER_SMOOTHING_DEFAULT (classifier_t::SMOOTHING_DEFAULT)
 #define LABEL_DEFAULT ""
 
 #define SHARED_DIR "/usr/share/gstnninferencedemo/"
@@ -81,95 +122,1408 @@ enum {
   PROP_DISPLAY_STATS,
   PROP_ENABLE_INFERENCE,
   PROP_USE_NNAPI,
-  PROP_NUM_THREADS
+  PROP_NUM_THREADS,
+  PROP_OVERLAY_MODE,
+  PROP_INPUT_STATS,
+  PROP_QOS_SHEDDING,
+  PROP_QOS_LEVEL,
+  PROP_INFERENCE_MODE,
+  PROP_INFERENCE_INTERVAL,
+  PROP_REPLICAS,
+  PROP_STARTUP,
+  PROP_STARTUP_STATS,
+  PROP_LATENCY_STATS,
+  PROP_CPU_AFFINITY,
+  PROP_SCHED_POLICY,
+  PROP_SCHED_PRIORITY,
+  PROP_AUTOTUNE_THREADS,
+  PROP_SECONDARY_MODEL,
+  PROP_CASCADE_LABEL,
+  PROP_CASCADE_MAX_CROPS,
+  PROP_CLASSIFIER_TOP_K,
+  PROP_CLASSIFIER_SMOOTHING,
+  PROP_CPU_POOL_THREADS,
+  PROP_CPU_POOL_AFFINITY
 };
 
+/* smoothed proportion above which qos_level i is raised to i + 1 */
+static const gdouble qos_raise_threshold[] = {1.05, 1.25, 1.5};
+
 static GstElementClass *parent_class = NULL;
 
+/* the CPU pool is shared by the elements of the process, so are its
+ * settings: the first element setting cpu-pool-threads or cpu-pool-affinity
+ * fixes it, other values are ignored with a warning */
+G_LOCK_DEFINE_STATIC (cpu_pool);
+static gint cpu_pool_threads = CPU_POOL_THREADS_DEFAULT;
+static gboolean cpu_pool_threads_set = FALSE;
+static gchar *cpu_pool_affinity = NULL;
+static gboolean cpu_pool_affinity_set = FALSE;
+/* bumped when a setting is fixed, the elements take the pool again */
+static guint cpu_pool_generation = 0;
+
 GST_DEBUG_CATEGORY (nninferencedemo_debug);
 #define GST_CAT_DEFAULT nninferencedemo_debug
 
 
-static int
-nninferencedemo_init (
+/* the affinity/scheduling properties as a policy. Nothing is changed until
+ * they are set, an emptied cpu-affinity goes back to every CPU */
+static void
+thread_policy_get (
+  GstNnInferenceDemo * demo,
+  thread_policy_t *thread_policy)
+{
+  static const int policy[] = {SCHED_OTHER, SCHED_FIFO, SCHED_RR};
+
+  if (demo->cpu_affinity && demo->cpu_affinity[0]) {
+    if (thread_policy->set_cpus (demo->cpu_affinity) != 0)
+      GST_WARNING_OBJECT (demo, "ignoring cpu-affinity \"%s\"", demo->cpu_affinity);
+  } else if (demo->cpu_affinity_set) {
+    thread_policy->set_all_cpus ();
+  }
+  if (demo->sched_policy_set)
+    thread_policy->set_scheduler (policy[demo->sched_policy], demo->sched_priority);
+}
+
+/* hand the affinity/scheduling properties to the inference object, the
+ * thread running the model applies them before its next run. Called with
+ * inference_lock held */
+static void
+apply_thread_policy (
+  GstNnInferenceDemo * demo)
+{
+  thread_policy_t thread_policy;
+
+  /* the pooled replicas are updated by replica_adopt() */
+  demo->replica_policy_changed = TRUE;
+  if (!demo->inference)
+    return;
+
+  thread_policy_get (demo, &thread_policy);
+  demo->inference->set_thread_policy (thread_policy);
+}
+
+static void
+cpu_pool_set_threads (
+  GstNnInferenceDemo * demo,
+  gint threads)
+{
+  G_LOCK (cpu_pool);
+  if (!cpu_pool_threads_set) {
+    cpu_pool_threads = threads;
+    cpu_pool_threads_set = TRUE;
+    cpu_pool_generation++;
+  } else if (threads != cpu_pool_threads) {
+    GST_WARNING_OBJECT (demo, "cpu-pool-threads is already %d for the "
+        "process, ignoring %d", cpu_pool_threads, threads);
+  }
+  G_UNLOCK (cpu_pool);
+}
+
+static void
+cpu_pool_set_affinity (
+  GstNnInferenceDemo * demo,
+  const gchar *affinity)
+{
+  G_LOCK (cpu_pool);
+  if (!cpu_pool_affinity_set) {
+    g_free (cpu_pool_affinity);
+    cpu_pool_affinity = g_strdup (affinity);
+    cpu_pool_affinity_set = TRUE;
+    cpu_pool_generation++;
+  } else if (g_strcmp0 (affinity ? affinity : "",
+        cpu_pool_affinity ? cpu_pool_affinity : "") != 0) {
+    GST_WARNING_OBJECT (demo, "cpu-pool-affinity is already \"%s\" for the "
+        "process, ignoring \"%s\"", cpu_pool_affinity ? cpu_pool_affinity : "",
+        affinity ? affinity : "");
+  }
+  G_UNLOCK (cpu_pool);
+}
+
+/* take the shared CPU pool at cpu-pool-threads, pinned to cpu-pool-affinity,
+ * and hand it to the inference object, with inference_lock held */
+static void
+cpu_pool_apply (
   GstNnInferenceDemo * demo)
+{
+  thread_policy_t thread_policy;
+  gint threads;
+  gchar *affinity;
+
+  G_LOCK (cpu_pool);
+  threads = cpu_pool_threads;
+  affinity = g_strdup (cpu_pool_affinity ? cpu_pool_affinity : "");
+  demo->cpu_pool_generation = cpu_pool_generation;
+  G_UNLOCK (cpu_pool);
+
+  *demo->cpu_pool = worker_pool_t::shared (threads);
+  if (thread_policy.set_cpus (affinity) != 0)
+    GST_WARNING_OBJECT (demo, "ignoring cpu-pool-affinity \"%s\"", affinity);
+  (*demo->cpu_pool)->set_thread_policy (thread_policy);
+  if (demo->inference)
+    demo->inference->set_worker_pool (*demo->cpu_pool);
+  g_free (affinity);
+}
+
+/* the pool, taken on first use and after a settings change, with
+ * inference_lock held */
+static std::shared_ptr<worker_pool_t>
+cpu_pool_get (
+  GstNnInferenceDemo * demo)
+{
+  gboolean stale;
+
+  G_LOCK (cpu_pool);
+  stale = (demo->cpu_pool_generation != cpu_pool_generation);
+  G_UNLOCK (cpu_pool);
+  if (!*demo->cpu_pool || stale)
+    cpu_pool_apply (demo);
+  return *demo->cpu_pool;
+}
+
+/* called from the thread running the model */
+static void
+post_autotune_decision (
+  GstNnInferenceDemo * demo,
+  const inference_t::autotune_decision_t& decision)
+{
+  GstStructure *s = gst_structure_new ("nninferencedemo-autotune",
+      "num-threads", G_TYPE_INT, decision.num_threads_,
+      "p50", G_TYPE_DOUBLE, decision.p50_,
+      "probed-threads", G_TYPE_INT, decision.probed_threads_,
+      "probed-p50", G_TYPE_DOUBLE, decision.probed_p50_,
+      "switched", G_TYPE_BOOLEAN, (gboolean) decision.switched_,
+      NULL);
+
+  gst_element_post_message (GST_ELEMENT (demo),
+      gst_message_new_element (GST_OBJECT (demo), s));
+}
+
+/* settings an inference object is built from, copied so it can be built
+ * outside of the streaming thread */
+struct inference_config_t {
+  GstNnInferenceDemo::DemoMode demo_mode;
+  std::string model;
+  std::string label;
+  std::string secondary_model;
+  gint use_nnapi;
+  gint num_threads;
+  gint cascade_label;
+  gint cascade_max_crops;
+  gint classifier_top_k;
+  gfloat classifier_smoothing;
+  /* taken by the building thread, see reload_run() */
+  thread_policy_t thread_policy;
+};
+
+static void
+inference_config_get (
+  GstNnInferenceDemo * demo,
+  inference_config_t *config)
+{
+  config->demo_mode = demo->demo_mode;
+  config->model = demo->model ? demo->model : "";
+  config->label = demo->label ? demo->label : "";
+  config->secondary_model = demo->secondary_model ? demo->secondary_model : "";
+  config->use_nnapi = demo->use_nnapi;
+  config->num_threads = demo->num_threads;
+  config->cascade_label = demo->cascade_label;
+  config->cascade_max_crops = demo->cascade_max_crops;
+  config->classifier_top_k = demo->classifier_top_k;
+  config->classifier_smoothing = demo->classifier_smoothing;
+  thread_policy_get (demo, &config->thread_policy);
+}
+
+/* build and load the model, does not touch the element */
+static inference_t *
+inference_create (
+  const inference_config_t& config)
 {
   int ret = 0;
-  demo->inference = NULL;
-  switch (demo->demo_mode) {
+  inference_t *result = NULL;
+
+  switch (config.demo_mode) {
     case GstNnInferenceDemo::tflite_posenet: {
       posenet_t *inference = new posenet_t ();
       std::string model (DEFAULT_MODEL_POSENET);
-      if (demo->model)
+      if (!config.model.empty())
       {
-        model = demo->model;
+        model = config.model;
       }
-      ret = inference->init (model, demo->use_nnapi, demo->num_threads);
-      demo->inference = inference;
+      ret = inference->init (model, config.use_nnapi, config.num_threads);
+      result = inference;
       break;
     }
     case GstNnInferenceDemo::tflite_mobilenet_ssd: {
       mobilenet_ssd_t *inference = new mobilenet_ssd_t ();
       std::string model (DEFAULT_MODEL_MOBILENET_SSD);
-      if (demo->model) {
-        model = demo->model;
+      if (!config.model.empty()) {
+        model = config.model;
       }
-      ret = inference->init (model, demo->use_nnapi, demo->num_threads);
+      ret = inference->init (model, config.use_nnapi, config.num_threads);
       if (ret == 0) {
         std::string label (DEFAULT_LABEL_MOBILENET_SSD);
-        if (demo->label) {
-          ret = inference->load_labels (demo->label);
+        if (!config.label.empty()) {
+          ret = inference->load_labels (config.label);
         }
         else {
           ret = inference->load_labels (label);
         }
       }
-      demo->inference = inference;
+      result = inference;
       break;
     }
     case GstNnInferenceDemo::tflite_benchmark: {
+      if (config.model.empty()) {
+        GST_ERROR ("invalid model");
+        return NULL;
+      }
       tflite_benchmark_t *inference = new tflite_benchmark_t ();
-      if (!demo->model) {
+      ret = inference->init (config.model, config.use_nnapi, config.num_threads);
+      result = inference;
+      break;
+    }
+    case GstNnInferenceDemo::tflite_cascade: {
+      cascade_t *inference = new cascade_t ();
+      std::string model (DEFAULT_MODEL_MOBILENET_SSD);
+      std::string label (DEFAULT_LABEL_MOBILENET_SSD);
+      std::string secondary_model (DEFAULT_MODEL_POSENET);
+      if (!config.model.empty())
+        model = config.model;
+      if (!config.label.empty())
+        label = config.label;
+      if (!config.secondary_model.empty())
+        secondary_model = config.secondary_model;
+      ret = inference->init (model, label, secondary_model, config.use_nnapi,
+          config.num_threads);
+      inference->set_crop_label (config.cascade_label);
+      inference->set_max_crops (config.cascade_max_crops);
+      result = inference;
+      break;
+    }
+    case GstNnInferenceDemo::tflite_classifier: {
+      if (config.model.empty()) {
         GST_ERROR ("invalid model");
-        return -1;
+        return NULL;
+      }
+      classifier_t *inference = new classifier_t ();
+      ret = inference->init (config.model, config.use_nnapi, config.num_threads);
+      if (ret == 0 && !config.label.empty()) {
+        ret = inference->load_labels (config.label);
       }
-      std::string model = demo->model;
-      ret = inference->init (model, demo->use_nnapi, demo->num_threads);
-      demo->inference = inference;
+      inference->set_top_k (config.classifier_top_k);
+      inference->set_smoothing (config.classifier_smoothing);
+      result = inference;
+      break;
+    }
+    case GstNnInferenceDemo::tflite_segmentation: {
+      if (config.model.empty()) {
+        GST_ERROR ("invalid model");
+        return NULL;
+      }
+      segmentation_t *inference = new segmentation_t ();
+      ret = inference->init (config.model, config.use_nnapi, config.num_threads);
+      result = inference;
       break;
     }
     default:
       GST_ERROR ("Invalid demo_mode");
-      return -1;
+      return NULL;
   }
 
   if (ret != 0) {
     GST_ERROR ("Failed to init NN Inference demo");
-    return -1;
+    delete result;
+    return NULL;
+  }
+  return result;
+}
+
+/* running time of buffer in seconds, the stream time results are filtered
+ * and extrapolated over. Monotonic time for buffers without a timestamp */
+static gdouble
+frame_time (
+  GstNnInferenceDemo * demo,
+  GstBuffer * buffer)
+{
+  GstClockTime t = gst_segment_to_running_time (
+      &GST_BASE_TRANSFORM (demo)->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+
+  if (!GST_CLOCK_TIME_IS_VALID (t))
+    return (gdouble) g_get_monotonic_time () / G_USEC_PER_SEC;
+  return (gdouble) t / GST_SECOND;
+}
+
+/* replace the running inference object, from the streaming thread. The
+ * runtime settings are applied again to the new one */
+static void
+inference_install (
+  GstNnInferenceDemo * demo,
+  inference_t *inference,
+  GstNnInferenceDemo::DemoMode demo_mode)
+{
+  g_mutex_lock (&demo->inference_lock);
+  /* the worker runs the inference object, stop it first */
+  if (demo->inference_worker) {
+    delete demo->inference_worker;
+    demo->inference_worker = NULL;
+  }
+  if (demo->inference) {
+    delete demo->inference;
+  }
+  demo->inference = inference;
+  demo->inference_demo_mode = demo_mode;
+  demo->mask_disabled = FALSE;
+
+  apply_thread_policy (demo);
+  demo->inference->set_worker_pool (cpu_pool_get (demo));
+  demo->inference->set_autotune_callback (
+      [demo] (const inference_t::autotune_decision_t& decision) {
+        post_autotune_decision (demo, decision);
+      });
+  if (demo->autotune_threads &&
+      demo->inference->set_autotune (TRUE) != 0)
+    GST_WARNING_OBJECT (demo, "thread count autotuning not supported");
+  if (demo->inference_mode == GstNnInferenceDemo::inference_latest)
+    demo->inference_worker = new inference_worker_t (demo->inference);
+  g_mutex_unlock (&demo->inference_lock);
+}
+
+/* canvas drawing straight into a mapped frame, NULL if the format can't be
+ * drawn into */
+static canvas_t *
+frame_canvas_new (
+  GstVideoFrame *out)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (out);
+
+  if ((format == GST_VIDEO_FORMAT_BGRx) || (format == GST_VIDEO_FORMAT_BGRA)) {
+    cv::Mat frameBGRX (GST_VIDEO_FRAME_HEIGHT (out), GST_VIDEO_FRAME_WIDTH (out),
+        CV_8UC4, GST_VIDEO_FRAME_PLANE_DATA (out, 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE (out, 0));
+    return new mat_canvas_t (frameBGRX);
+  } else if ((format == GST_VIDEO_FORMAT_NV12) || (format == GST_VIDEO_FORMAT_I420)) {
+    uint8_t *plane[3] = {NULL, NULL, NULL};
+    int stride[3] = {0, 0, 0};
+    for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES (out); i++) {
+      plane[i] = (uint8_t *) GST_VIDEO_FRAME_PLANE_DATA (out, i);
+      stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (out, i);
+    }
+    return new yuv_canvas_t (GST_VIDEO_FRAME_WIDTH (out),
+        GST_VIDEO_FRAME_HEIGHT (out), format == GST_VIDEO_FORMAT_NV12,
+        plane, stride);
+  }
+
+  GST_WARNING ("Can't draw into %s frame", gst_video_format_to_string (format));
+  return NULL;
+}
+
+/* scale and blend the mask of heads with per pixel results, the CPU only
+ * writes it at model resolution */
+static void
+mask_blend (
+  GstNnInferenceDemo * demo,
+  inference_t *inference,
+  Imx2DFrame *dst_frame)
+{
+  int width = 0;
+  int height = 0;
+
+  if (demo->mask_disabled ||
+      !inference->get_mask_size (&width, &height))
+    return;
+
+  if (!demo->allocator)
+    demo->allocator =
+        gst_imx_2d_device_allocator_new((gpointer)(demo->device));
+
+  if (!demo->mask_layer)
+    demo->mask_layer = new mask_layer_t ();
+
+  if (demo->mask_layer->init (demo->device, demo->allocator,
+        width, height) != 0) {
+    GST_WARNING ("Failed to init mask layer, no mask");
+    demo->mask_disabled = TRUE;
+    return;
+  }
+
+  uint8_t *bgra = demo->mask_layer->begin ();
+  if (!bgra || inference->draw_mask (bgra, width * 4) != 0
+      || demo->mask_layer->end (dst_frame) != 0) {
+    GST_WARNING ("Failed to blend mask, no mask");
+    demo->mask_disabled = TRUE;
+  }
+}
+
+/* drop the replicas built or being built for the pool, a build in progress
+ * sees its replica_serial is stale. inference_lock held */
+static void
+replica_cancel (
+  GstNnInferenceDemo * demo)
+{
+  demo->replica_serial++;
+  if (demo->replica_config) {
+    delete demo->replica_config;
+    demo->replica_config = NULL;
+  }
+  for (size_t i = 0; i < demo->replica_inferences->size (); i++)
+    delete (*demo->replica_inferences)[i];
+  demo->replica_inferences->clear ();
+}
+
+/* one more replica of the running model for the pool, from reload_thread
+ * with inference_lock held */
+static void
+replica_build (
+  GstNnInferenceDemo * demo)
+{
+  inference_config_t config = *demo->replica_config;
+  guint serial = demo->replica_serial;
+  /* the placement may have changed since the pool was started */
+  thread_policy_get (demo, &config.thread_policy);
+  g_mutex_unlock (&demo->inference_lock);
+
+  config.thread_policy.apply (0);
+  inference_t *replica = inference_create (config);
+
+  g_mutex_lock (&demo->inference_lock);
+  /* the pool was released meanwhile */
+  if (serial != demo->replica_serial) {
+    delete replica;
+    return;
   }
+  if (replica) {
+    demo->replica_inferences->push_back (replica);
+    demo->replica_wanted--;
+  } else {
+    GST_WARNING_OBJECT (demo, "failed to build a replica, %u missing",
+        demo->replica_wanted);
+    demo->replica_wanted = 0;
+  }
+  if (!demo->replica_wanted) {
+    delete demo->replica_config;
+    demo->replica_config = NULL;
+  }
+}
+
+/* hot model swap: the new model is built by reload_thread while the current
+ * one keeps running, then swapped in by the streaming thread between two
+ * frames. Settings changed during a build queue one more build. The
+ * replicas of offline and hetero modes are built by the same thread, one
+ * at a time, after the model builds */
+static void
+reload_run (
+  GstNnInferenceDemo * demo)
+{
+  g_mutex_lock (&demo->inference_lock);
+  while (demo->reload_config || demo->replica_config) {
+    if (!demo->reload_config) {
+      replica_build (demo);
+      continue;
+    }
+    inference_config_t *config = demo->reload_config;
+    demo->reload_config = NULL;
+    g_mutex_unlock (&demo->inference_lock);
+
+    GST_INFO_OBJECT (demo, "loading %s", config->model.c_str ());
+    /* the runtime threads created while building inherit the placement of
+     * this thread */
+    config->thread_policy.apply (0);
+    inference_t *inference = inference_create (*config);
+    GstNnInferenceDemo::DemoMode demo_mode = config->demo_mode;
+    std::string model = config->model;
+    delete config;
+
+    g_mutex_lock (&demo->inference_lock);
+    /* superseded while loading */
+    if (demo->reload_config) {
+      delete inference;
+      continue;
+    }
+    if (!inference && (demo->inference || demo->reload_inference)) {
+      GST_ELEMENT_WARNING (demo, RESOURCE, FAILED,
+          ("Failed to load the new model, keeping the current one"),
+          ("model %s", model.c_str ()));
+      continue;
+    }
+    /* nothing to keep running, the stream stops at its next frame */
+    if (!inference) {
+      demo->reload_failed = TRUE;
+      GST_ELEMENT_ERROR (demo, RESOURCE, FAILED,
+          ("Failed to load the model"), ("model %s", model.c_str ()));
+      continue;
+    }
+    if (demo->reload_inference)
+      delete demo->reload_inference;
+    demo->reload_inference = inference;
+    demo->reload_demo_mode = demo_mode;
+    /* the replicas of the model it replaces are not needed anymore */
+    replica_cancel (demo);
+    g_cond_broadcast (&demo->reload_cond);
+  }
+  demo->reload_running = FALSE;
+  g_cond_broadcast (&demo->reload_cond);
+  g_mutex_unlock (&demo->inference_lock);
+}
+
+/* run reload_run() unless it is running, inference_lock held */
+static void
+reload_thread_start (
+  GstNnInferenceDemo * demo)
+{
+  if (demo->reload_running)
+    return;
+  /* the previous one is done */
+  if (demo->reload_thread) {
+    demo->reload_thread->join ();
+    delete demo->reload_thread;
+  }
+  demo->reload_running = TRUE;
+  demo->reload_thread = new std::thread (reload_run, demo);
+}
+
+/* offline and hetero modes run frames on replicas of the model, frames are
+ * held by the element until their results are drawn, then pushed in PTS
+ * order. Offline mode uses the replicas in turn and infers every frame,
+ * hetero mode sends each frame to the replica that will finish first */
+static gboolean
+replica_mode (
+  GstNnInferenceDemo::InferenceMode mode)
+{
+  return (mode == GstNnInferenceDemo::inference_offline) ||
+      (mode == GstNnInferenceDemo::inference_hetero);
+}
+
+/* frames run on the running model until the other replicas, built by
+ * reload_thread, are added by replica_adopt() */
+static int
+offline_start (
+  GstNnInferenceDemo * demo)
+{
+  inference_config_t *config = new inference_config_t ();
+  guint replicas = demo->replicas;
+
+  inference_config_get (demo, config);
+  demo->replica_mode = demo->inference_mode;
+  if (demo->replica_mode == GstNnInferenceDemo::inference_hetero) {
+    /* the configured backend, plus the CPU cores left idle meanwhile */
+    config->use_nnapi = 3;
+    replicas = 2;
+  }
+  demo->replica_pool = new replica_pool_t (demo->inference);
+  demo->offline_next = 0;
+  demo->offline_last = -1;
+  GST_INFO_OBJECT (demo, "%s mode, building %u more replicas",
+      demo->replica_mode == GstNnInferenceDemo::inference_hetero ?
+      "hetero" : "offline", replicas - 1);
+
+  g_mutex_lock (&demo->inference_lock);
+  replica_cancel (demo);
+  if (replicas > 1) {
+    demo->replica_config = config;
+    demo->replica_wanted = replicas - 1;
+    reload_thread_start (demo);
+    config = NULL;
+  }
+  g_mutex_unlock (&demo->inference_lock);
+  delete config;
   return 0;
 }
 
+/* add the replicas built since the last frame to the pool */
+static void
+replica_adopt (
+  GstNnInferenceDemo * demo)
+{
+  std::vector<inference_t *> built;
+  thread_policy_t thread_policy;
+  gboolean policy_changed;
+
+  if (!demo->replica_pool)
+    return;
+  g_mutex_lock (&demo->inference_lock);
+  built.swap (*demo->replica_inferences);
+  for (size_t i = 0; i < built.size (); i++) {
+    built[i]->set_num_threads (demo->num_threads);
+    built[i]->set_worker_pool (cpu_pool_get (demo));
+  }
+  policy_changed = demo->replica_policy_changed;
+  demo->replica_policy_changed = FALSE;
+  if (policy_changed)
+    thread_policy_get (demo, &thread_policy);
+  g_mutex_unlock (&demo->inference_lock);
+
+  for (size_t i = 0; i < built.size (); i++)
+    demo->replica_pool->add (built[i]);
+  if (!built.empty ())
+    GST_INFO_OBJECT (demo, "%zu replicas", demo->replica_pool->size ());
+  /* taken by each replica before its next run */
+  for (size_t i = 0; policy_changed && i < demo->replica_pool->size (); i++)
+    demo->replica_pool->get (i)->set_thread_policy (thread_policy);
+}
+
+/* a held frame can be drawn once its replica is done */
+static gboolean
+offline_ready (
+  GstNnInferenceDemo * demo,
+  const GstNnInferenceDemo::offline_frame_t& frame)
+{
+  return (frame.replica < 0) ||
+      !demo->replica_pool->worker (frame.replica)->busy ();
+}
+
+/* draw the results of a held frame as nninference() does, its replica must
+ * be done. The stats are counted on the running model, once per frame.
+ * Never called on the frame being transformed, see offline_push(), so the
+ * buffer is only held here and is drawn in place, where the 2D frame points */
+static void
+offline_draw (
+  GstNnInferenceDemo * demo,
+  GstNnInferenceDemo::offline_frame_t& frame)
+{
+  inference_t *replica = NULL;
+  GstVideoFrame out;
+  canvas_t *canvas;
+
+  frame.drawn = TRUE;
+  if (frame.replica >= 0)
+    replica = demo->replica_pool->get (frame.replica);
+  if (replica && demo->enable_inference && frame.dst.mem) {
+    frame.dst.mem = &frame.dst_mem;
+    if (demo->device->config_output (demo->device, &frame.dst.info) == 0)
+      mask_blend (demo, replica, &frame.dst);
+  }
+  if (!gst_video_frame_map (&out, &frame.info, frame.buffer,
+        GST_MAP_READWRITE)) {
+    GST_WARNING_OBJECT (demo, "failed to map held frame");
+    return;
+  }
+  canvas = frame_canvas_new (&out);
+  if (canvas) {
+    if (replica && demo->enable_inference) {
+      replica->set_draw_time (frame_time (demo, frame.buffer));
+      replica->draw_results (*canvas);
+    }
+    demo->inference->calc_stats (*canvas);
+    if (demo->qos_draw_stats)
+      demo->inference->draw_stats (*canvas);
+    delete canvas;
+  }
+  gst_video_frame_unmap (&out);
+}
+
+/* wait for and draw the frames a replica still holds results for */
+static void
+offline_draw_replica (
+  GstNnInferenceDemo * demo,
+  gint replica)
+{
+  std::deque<GstNnInferenceDemo::offline_frame_t>& frames = *demo->offline_frames;
+
+  for (size_t i = 0; i < frames.size (); i++) {
+    if (!frames[i].drawn && frames[i].replica == replica) {
+      demo->replica_pool->worker (replica)->wait ();
+      offline_draw (demo, frames[i]);
+    }
+  }
+}
+
+static void
+offline_submit (
+  GstNnInferenceDemo * demo,
+  GObject *object,
+  GstVideoInfo *vinfo,
+  Imx2DFrame *src_frame,
+  Imx2DFrame *dst_frame,
+  gdouble time)
+{
+  guint replica;
+
+  /* for offline_queue(), the device may not reach the output */
+  demo->offline_frame.replica = -1;
+  demo->offline_frame.dst.mem = NULL;
+  if (dst_frame) {
+    demo->offline_frame.dst = *dst_frame;
+    demo->offline_frame.dst_mem = *dst_frame->mem;
+  }
+  if (!demo->qos_run_inference)
+    return;
+  if (!demo->replica_pool && offline_start (demo) != 0)
+    return;
+
+  if (demo->replica_mode == GstNnInferenceDemo::inference_hetero) {
+    replica = demo->replica_pool->earliest ();
+    /* better wait for the busy one than start on a slower one, the frame
+     * is drawn with the results of the last frame submitted */
+    if (demo->replica_pool->worker (replica)->busy ()) {
+      demo->inference_discarded_count++;
+      demo->offline_frame.replica = demo->offline_last;
+      return;
+    }
+  } else {
+    replica = demo->offline_next;
+    demo->offline_next = (replica + 1) % demo->replica_pool->size ();
+  }
+  /* one frame in flight per replica */
+  offline_draw_replica (demo, replica);
+
+  demo->replica_pool->get (replica)->set_input_time (time);
+  if (demo->replica_pool->get (replica)->setup_input_tensor (object, vinfo,
+        src_frame, dst_frame) != 0
+      || demo->replica_pool->submit (replica) != 0)
+    return;
+  demo->offline_frame.replica = replica;
+  demo->offline_last = replica;
+}
+
+/* the time frames are held until their results are drawn adds to the
+ * latency reported upstream */
+static void
+offline_hold_update (
+  GstNnInferenceDemo * demo,
+  GstClockTime held)
+{
+  GstClockTime latency = 0;
+
+  GST_OBJECT_LOCK (demo);
+  if (demo->hold_latency == 0)
+    demo->hold_latency = held;
+  else
+    demo->hold_latency = LATENCY_SMOOTHING * held +
+        (1.0 - LATENCY_SMOOTHING) * demo->hold_latency;
+  if (demo->processing_latency + demo->hold_latency >
+      LATENCY_MARGIN * demo->reported_latency) {
+    demo->reported_latency = demo->processing_latency + demo->hold_latency;
+    latency = demo->reported_latency;
+  }
+  GST_OBJECT_UNLOCK (demo);
+
+  if (latency) {
+    GST_DEBUG_OBJECT (demo, "latency with held frames now %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (latency));
+    gst_element_post_message (GST_ELEMENT (demo),
+        gst_message_new_latency (GST_OBJECT (demo)));
+  }
+}
+
+/* push the held frames that are ready, in order, all of them on drain.
+ * held is the buffer the base class still has mapped for the transform, it
+ * is left for the next call, once the transform has returned */
+static GstFlowReturn
+offline_push (
+  GstNnInferenceDemo * demo,
+  gboolean drain,
+  GstBuffer *held)
+{
+  std::deque<GstNnInferenceDemo::offline_frame_t>& frames = *demo->offline_frames;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  for (size_t i = 0; i < frames.size (); i++) {
+    if (!frames[i].drawn && frames[i].buffer != held &&
+        offline_ready (demo, frames[i]))
+      offline_draw (demo, frames[i]);
+  }
+
+  while (!frames.empty () && ret == GST_FLOW_OK) {
+    GstNnInferenceDemo::offline_frame_t& frame = frames.front ();
+    if (!frame.drawn) {
+      if (!drain)
+        break;
+      if (frame.replica >= 0)
+        demo->replica_pool->worker (frame.replica)->wait ();
+      offline_draw (demo, frame);
+    }
+    GstBuffer *buffer = frame.buffer;
+    offline_hold_update (demo,
+        (g_get_monotonic_time () - frame.queue_time) * GST_USECOND);
+    frames.pop_front ();
+    ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (demo), buffer);
+  }
+  return ret;
+}
+
+/* hold the output of the frame just processed */
+static GstFlowReturn
+offline_queue (
+  GstNnInferenceDemo * demo,
+  GstVideoFrame *out)
+{
+  std::deque<GstNnInferenceDemo::offline_frame_t>& frames = *demo->offline_frames;
+  GstNnInferenceDemo::offline_frame_t frame = demo->offline_frame;
+  GstBuffer *buffer = out->buffer;
+  GstFlowReturn ret;
+
+  frame.buffer = gst_buffer_ref (buffer);
+  frame.info = out->info;
+  frame.drawn = FALSE;
+  frame.queue_time = g_get_monotonic_time ();
+
+  /* by PTS, frames without one keep their arrival order */
+  auto it = frames.end ();
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    while (it != frames.begin () && GST_BUFFER_PTS_IS_VALID ((it - 1)->buffer) &&
+        GST_BUFFER_PTS ((it - 1)->buffer) > GST_BUFFER_PTS (buffer))
+      it--;
+  }
+  frames.insert (it, frame);
+
+  ret = offline_push (demo, FALSE, buffer);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
+
+/* drop the held frames, on flush and stop */
+static void
+offline_flush (
+  GstNnInferenceDemo * demo)
+{
+  std::deque<GstNnInferenceDemo::offline_frame_t>& frames = *demo->offline_frames;
+
+  if (demo->replica_pool)
+    demo->replica_pool->wait_all ();
+  for (size_t i = 0; i < frames.size (); i++)
+    gst_buffer_unref (frames[i].buffer);
+  frames.clear ();
+}
+
+/* push what is held and release the replicas, before the model or the
+ * inference mode changes */
+static void
+offline_stop (
+  GstNnInferenceDemo * demo)
+{
+  if (!demo->replica_pool)
+    return;
+  if (offline_push (demo, TRUE, NULL) != GST_FLOW_OK)
+    offline_flush (demo);
+  delete demo->replica_pool;
+  demo->replica_pool = NULL;
+  g_mutex_lock (&demo->inference_lock);
+  replica_cancel (demo);
+  g_mutex_unlock (&demo->inference_lock);
+
+  /* frames are not held anymore */
+  GST_OBJECT_LOCK (demo);
+  demo->hold_latency = 0;
+  GST_OBJECT_UNLOCK (demo);
+  gst_element_post_message (GST_ELEMENT (demo),
+      gst_message_new_latency (GST_OBJECT (demo)));
+}
+
+/* initial: first build, from READY to PAUSED, otherwise a rebuild of the
+ * running model */
+static void
+reload_start (
+  GstNnInferenceDemo * demo,
+  gboolean initial)
+{
+  inference_config_t *config = new inference_config_t ();
+  inference_config_get (demo, config);
+
+  g_mutex_lock (&demo->inference_lock);
+  /* a rebuild with nothing running is left to the first build, and the first
+   * build is only needed once */
+  if (initial ? (demo->inference || demo->reload_running || demo->reload_inference)
+      : !demo->inference) {
+    g_mutex_unlock (&demo->inference_lock);
+    delete config;
+    return;
+  }
+  if (demo->reload_config)
+    delete demo->reload_config;
+  demo->reload_config = config;
+  if (initial)
+    demo->reload_failed = FALSE;
+  reload_thread_start (demo);
+  g_mutex_unlock (&demo->inference_lock);
+}
+
+/* from the streaming thread, before the frame uses the inference object.
+ * GST_FLOW_ERROR once the first build failed, the error is already posted */
+static GstFlowReturn
+reload_swap (
+  GstNnInferenceDemo * demo)
+{
+  inference_t *inference;
+  GstNnInferenceDemo::DemoMode demo_mode;
+  gboolean stop_replicas;
+
+  /* the replicas are copies of the running model */
+  g_mutex_lock (&demo->inference_lock);
+  stop_replicas = demo->replica_pool && (demo->reload_inference ||
+      demo->inference_mode != demo->replica_mode);
+  g_mutex_unlock (&demo->inference_lock);
+  if (stop_replicas)
+    offline_stop (demo);
+  replica_adopt (demo);
+
+  g_mutex_lock (&demo->inference_lock);
+  inference = demo->reload_inference;
+  /* let the worker finish its run instead of waiting for it */
+  if (demo->inference_worker && demo->inference_worker->busy ()) {
+    g_mutex_unlock (&demo->inference_lock);
+    return GST_FLOW_OK;
+  }
+  if (!inference && !demo->inference && demo->reload_failed) {
+    g_mutex_unlock (&demo->inference_lock);
+    return GST_FLOW_ERROR;
+  }
+  if (inference)
+    demo->reload_inference = NULL;
+  demo_mode = demo->reload_demo_mode;
+  /* inference-mode changed, no need for a new model */
+  if (!inference && demo->inference &&
+      ((demo->inference_mode == GstNnInferenceDemo::inference_latest) !=
+       (demo->inference_worker != NULL))) {
+    if (demo->inference_worker) {
+      delete demo->inference_worker;
+      demo->inference_worker = NULL;
+    } else {
+      demo->inference_worker = new inference_worker_t (demo->inference);
+    }
+  }
+  g_mutex_unlock (&demo->inference_lock);
+
+  if (!inference)
+    return GST_FLOW_OK;
+
+  inference_install (demo, inference, demo_mode);
+  GST_INFO_OBJECT (demo, "switched to the new model");
+  gst_element_post_message (GST_ELEMENT (demo),
+      gst_message_new_element (GST_OBJECT (demo),
+          gst_structure_new_empty ("nninferencedemo-reloaded")));
+  return GST_FLOW_OK;
+}
+
+/* "reload" action signal */
+static void
+reload (
+  GstNnInferenceDemo * demo)
+{
+  reload_start (demo, FALSE);
+}
+
+/* wait for the build in progress, if any, and swap it in */
+static void
+reload_wait (
+  GstNnInferenceDemo * demo)
+{
+  g_mutex_lock (&demo->inference_lock);
+  while (demo->reload_running && !demo->reload_inference)
+    g_cond_wait (&demo->reload_cond, &demo->inference_lock);
+  g_mutex_unlock (&demo->inference_lock);
+
+  reload_swap (demo);
+}
+
+/* stop a build in progress and drop what was not swapped in */
+static void
+reload_stop (
+  GstNnInferenceDemo * demo)
+{
+  std::thread *thread;
+
+  g_mutex_lock (&demo->inference_lock);
+  if (demo->reload_config) {
+    delete demo->reload_config;
+    demo->reload_config = NULL;
+  }
+  replica_cancel (demo);
+  thread = demo->reload_thread;
+  demo->reload_thread = NULL;
+  g_mutex_unlock (&demo->inference_lock);
+
+  if (thread) {
+    thread->join ();
+    delete thread;
+  }
+  if (demo->reload_inference) {
+    delete demo->reload_inference;
+    demo->reload_inference = NULL;
+  }
+}
+
+static canvas_t *
+overlay_begin (
+  GstNnInferenceDemo * demo,
+  GstVideoFrame *out)
+{
+  if (!demo->allocator)
+    demo->allocator =
+        gst_imx_2d_device_allocator_new((gpointer)(demo->device));
+
+  if (!demo->overlay)
+    demo->overlay = new overlay_t ();
+
+  if (demo->overlay->init (demo->device, demo->allocator,
+        GST_VIDEO_FRAME_WIDTH (out), GST_VIDEO_FRAME_HEIGHT (out)) != 0) {
+    GST_WARNING ("Failed to init overlay plane, drawing into the frame");
+    demo->overlay_mode = GstNnInferenceDemo::overlay_frame;
+    return NULL;
+  }
+
+  return demo->overlay->begin ();
+}
+
+/* time to first frame and to first result since READY to PAUSED, posted
+ * once each as "nninferencedemo-startup" */
+static void
+startup_update (
+  GstNnInferenceDemo * demo,
+  GstClockTime *milestone,
+  const gchar *name)
+{
+  if (*milestone || !demo->startup_time)
+    return;
+
+  GST_OBJECT_LOCK (demo);
+  *milestone = (g_get_monotonic_time () - demo->startup_time) * GST_USECOND;
+  GST_OBJECT_UNLOCK (demo);
+
+  GST_INFO_OBJECT (demo, "%s after %" GST_TIME_FORMAT, name,
+      GST_TIME_ARGS (*milestone));
+  gst_element_post_message (GST_ELEMENT (demo),
+      gst_message_new_element (GST_OBJECT (demo),
+          gst_structure_new ("nninferencedemo-startup",
+              "event", G_TYPE_STRING, name,
+              "time", G_TYPE_UINT64, (guint64) *milestone,
+              NULL)));
+}
+
+/* infer_sink pad. Its buffers are queued as they come, with no back
+ * pressure on the second stream, and taken by the display stream */
+static void
+infer_clear (
+  GstNnInferenceDemo * demo)
+{
+  g_mutex_lock (&demo->infer_lock);
+  while (!demo->infer_buffers->empty ()) {
+    gst_buffer_unref (demo->infer_buffers->front ().buffer);
+    demo->infer_buffers->pop_front ();
+  }
+  g_mutex_unlock (&demo->infer_lock);
+}
+
+static gboolean
+infer_event (
+  GstPad * pad,
+  GstObject * parent,
+  GstEvent * event)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) parent;
+  GstCaps *caps;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+      gst_event_parse_caps (event, &caps);
+      g_mutex_lock (&demo->infer_lock);
+      demo->infer_info_valid = gst_video_info_from_caps (&demo->infer_info, caps);
+      g_mutex_unlock (&demo->infer_lock);
+      break;
+    /* the buffers are matched in running time, their PTS may not be in
+     * the same time base as the display stream */
+    case GST_EVENT_SEGMENT:
+      g_mutex_lock (&demo->infer_lock);
+      gst_event_copy_segment (event, &demo->infer_segment);
+      g_mutex_unlock (&demo->infer_lock);
+      break;
+    /* the pad is flushing already, infer_chain() queues nothing more */
+    case GST_EVENT_FLUSH_START:
+      infer_clear (demo);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&demo->infer_lock);
+      gst_segment_init (&demo->infer_segment, GST_FORMAT_TIME);
+      g_mutex_unlock (&demo->infer_lock);
+      infer_clear (demo);
+      break;
+    case GST_EVENT_EOS:
+      infer_clear (demo);
+      break;
+    default:
+      break;
+  }
+
+  /* nothing goes downstream from this pad */
+  gst_event_unref (event);
+  return TRUE;
+}
+
+static GstFlowReturn
+infer_chain (
+  GstPad * pad,
+  GstObject * parent,
+  GstBuffer * buffer)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) parent;
+  GstNnInferenceDemo::infer_buffer_t queued;
+
+  g_mutex_lock (&demo->infer_lock);
+  /* flushing or deactivated, checked under the lock the queue is cleared
+   * with so that nothing is queued after it */
+  if (GST_PAD_IS_FLUSHING (pad)) {
+    g_mutex_unlock (&demo->infer_lock);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_FLUSHING;
+  }
+  queued.buffer = buffer;
+  queued.running_time = gst_segment_to_running_time (&demo->infer_segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  /* no timestamp or out of segment, can't be matched */
+  if (!GST_CLOCK_TIME_IS_VALID (queued.running_time)) {
+    g_mutex_unlock (&demo->infer_lock);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_OK;
+  }
+  demo->infer_buffers->push_back (queued);
+  while (demo->infer_buffers->size () > INFER_QUEUE_SIZE) {
+    gst_buffer_unref (demo->infer_buffers->front ().buffer);
+    demo->infer_buffers->pop_front ();
+  }
+  g_mutex_unlock (&demo->infer_lock);
+  return GST_FLOW_OK;
+}
+
+static GstPad *
+request_new_pad (
+  GstElement * element,
+  GstPadTemplate * templ,
+  const gchar * name,
+  const GstCaps * caps)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) element;
+  GstPad *pad;
+
+  GST_OBJECT_LOCK (demo);
+  if (demo->infer_pad) {
+    GST_OBJECT_UNLOCK (demo);
+    GST_WARNING_OBJECT (demo, "infer_sink already requested");
+    return NULL;
+  }
+  GST_OBJECT_UNLOCK (demo);
+
+  pad = gst_pad_new_from_template (templ, "infer_sink");
+  gst_pad_set_event_function (pad, GST_DEBUG_FUNCPTR (infer_event));
+  gst_pad_set_chain_function (pad, GST_DEBUG_FUNCPTR (infer_chain));
+  gst_pad_set_active (pad, TRUE);
+  gst_element_add_pad (element, pad);
+
+  GST_OBJECT_LOCK (demo);
+  demo->infer_pad = pad;
+  GST_OBJECT_UNLOCK (demo);
+  return pad;
+}
+
+static void
+release_pad (
+  GstElement * element,
+  GstPad * pad)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) element;
+
+  GST_OBJECT_LOCK (demo);
+  demo->infer_pad = NULL;
+  GST_OBJECT_UNLOCK (demo);
+
+  g_mutex_lock (&demo->infer_lock);
+  demo->infer_info_valid = FALSE;
+  g_mutex_unlock (&demo->infer_lock);
+  infer_clear (demo);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+/* the second stream can replace the model input resize: same orientation,
+ * and a model that only reads its input */
+static gboolean
+infer_available (
+  GstNnInferenceDemo * demo)
+{
+  gboolean available;
+
+  if (!demo->infer_pad || demo->rotate != IMX_2D_ROTATION_0 ||
+      !demo->inference || demo->inference->needs_source_frame ())
+    return FALSE;
+
+  g_mutex_lock (&demo->infer_lock);
+  available = demo->infer_info_valid && !demo->infer_buffers->empty ();
+  g_mutex_unlock (&demo->infer_lock);
+  return available;
+}
+
+/* load the model input from the second stream buffer closest in running
+ * time to the display buffer, the older ones are dropped. FALSE if none is
+ * close enough */
+static gboolean
+infer_load (
+  GstNnInferenceDemo * demo,
+  GstBuffer *display)
+{
+  std::deque<GstNnInferenceDemo::infer_buffer_t>& buffers = *demo->infer_buffers;
+  GstBuffer *buffer = NULL;
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstClockTime tolerance = INFER_PTS_TOLERANCE;
+  GstClockTime running_time;
+  int ret;
+
+  running_time = gst_segment_to_running_time (
+      &GST_BASE_TRANSFORM (demo)->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (display));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time) || !infer_available (demo))
+    return FALSE;
+
+  g_mutex_lock (&demo->infer_lock);
+  info = demo->infer_info;
+  /* half a frame of the second stream */
+  if (GST_VIDEO_INFO_FPS_N (&info) > 0)
+    tolerance = gst_util_uint64_scale (GST_SECOND, GST_VIDEO_INFO_FPS_D (&info),
+        2 * GST_VIDEO_INFO_FPS_N (&info));
+
+  size_t best = buffers.size ();
+  GstClockTime best_diff = GST_CLOCK_TIME_NONE;
+  for (size_t i = 0; i < buffers.size (); i++) {
+    GstClockTime t = buffers[i].running_time;
+    GstClockTime diff = (t > running_time) ? t - running_time : running_time - t;
+    if (diff <= tolerance && diff < best_diff) {
+      best = i;
+      best_diff = diff;
+    }
+  }
+  if (best < buffers.size ()) {
+    buffer = buffers[best].buffer;
+    for (size_t i = 0; i < best; i++)
+      gst_buffer_unref (buffers[i].buffer);
+    buffers.erase (buffers.begin (), buffers.begin () + best + 1);
+  }
+  g_mutex_unlock (&demo->infer_lock);
+
+  if (!buffer) {
+    demo->infer_missed_count++;
+    return FALSE;
+  }
+
+  ret = -1;
+  if (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ)) {
+    ret = demo->inference->load_input_frame (
+        (const uint8_t *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),
+        GST_VIDEO_FRAME_FORMAT (&frame), GST_VIDEO_FRAME_WIDTH (&frame),
+        GST_VIDEO_FRAME_HEIGHT (&frame), GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0));
+    gst_video_frame_unmap (&frame);
+  }
+  gst_buffer_unref (buffer);
+
+  if (ret != 0) {
+    GST_LOG_OBJECT (demo, "infer_sink frame not usable as model input");
+    demo->infer_missed_count++;
+    return FALSE;
+  }
+  demo->infer_matched_count++;
+  return TRUE;
+}
+
 static int nninference (
   GObject *object,
   GstVideoInfo *vinfo,
   Imx2DFrame *src_frame,
-  Imx2DFrame *dst_frame)
+  Imx2DFrame *dst_frame,
+  GstVideoFrame *out,
+  gboolean input_ready,
+  gboolean pending)
 {
   GstNnInferenceDemo *demo = (GstNnInferenceDemo *) object;
   int ret = 0;
-  cv::Mat frameBGRX (vinfo->height, vinfo->width, CV_8UC4, dst_frame->mem->vaddr);
-  if (demo->inference) {
-    if (demo->enable_inference) {
+  gdouble time = frame_time (demo, out->buffer);
+  gboolean stats_drawn = FALSE;
+  canvas_t *canvas = NULL;
+  canvas_t *frame_canvas = NULL;
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (out);
+  gboolean is_yuv = (format == GST_VIDEO_FORMAT_NV12) ||
+      (format == GST_VIDEO_FORMAT_I420);
+
+  if (!demo->inference) {
+    if (pending)
+      demo->device->wait (demo->device);
+    return 0;
+  }
+
+  /* results are drawn once the replica is done, see offline_push() */
+  if (replica_mode (demo->inference_mode)) {
+    if (pending)
+      demo->device->wait (demo->device);
+    offline_submit (demo, object, vinfo, src_frame, dst_frame, time);
+    return 0;
+  }
+
+  /* YUV output is drawn in place, blending RGBA into it by 2D is not
+   * supported on every G2D. Without a dst frame the output is not
+   * reachable by the device, everything is drawn by CPU. */
+  if (demo->overlay_mode == GstNnInferenceDemo::overlay_plane && !is_yuv &&
+      dst_frame)
+    canvas = overlay_begin (demo, out);
+
+  if (!canvas) {
+    frame_canvas = frame_canvas_new (out);
+    canvas = frame_canvas;
+  }
+
+  /* the overlay plane does not depend on the 2D job in flight, draw the
+   * stats while it runs */
+  if (pending && canvas && !frame_canvas) {
+    ret = demo->inference->calc_stats (*canvas);
+    if (demo->qos_draw_stats)
+      ret = demo->inference->draw_stats (*canvas);
+    stats_drawn = TRUE;
+  }
+  if (pending)
+    demo->device->wait (demo->device);
+
+  if (demo->qos_run_inference) {
+    demo->inference->set_input_time (time);
+    /* the model input was already resized along with the display convert */
+    if (input_ready)
+      ret = demo->inference->load_input_tensor ();
+    else if (infer_load (demo, out->buffer))
+      ret = 0;
+    else
       ret = demo->inference->setup_input_tensor (object, vinfo, src_frame, dst_frame);
+    if (demo->inference_worker) {
+      ret = demo->inference_worker->submit ();
+    } else {
       ret = demo->inference->inference ();
-      ret = demo->inference->draw_results (frameBGRX);
+      if (ret == 0)
+        ret = demo->inference->parse_results ();
+      if (ret == 0)
+        startup_update (demo, &demo->first_result_time, "first-result");
     }
-    ret = demo->inference->calc_stats (frameBGRX);
-    if (demo->display_stats) {
-      ret = demo->inference->draw_stats (frameBGRX);
+  }
+  /* the worker has parsed results once its first request is done */
+  if (demo->inference_worker && !demo->first_result_time &&
+      demo->inference_worker->get_latency () > 0)
+    startup_update (demo, &demo->first_result_time, "first-result");
+  /* last results, also on frames without inference of their own, the
+   * mask goes under what the canvas draws */
+  if (demo->enable_inference && dst_frame)
+    mask_blend (demo, demo->inference, dst_frame);
+  if (demo->enable_inference && canvas) {
+    demo->inference->set_draw_time (time);
+    ret = demo->inference->draw_results (*canvas);
+  }
+  if (canvas && !stats_drawn) {
+    ret = demo->inference->calc_stats (*canvas);
+    if (demo->qos_draw_stats) {
+      ret = demo->inference->draw_stats (*canvas);
     }
   }
+
+  if (frame_canvas) {
+    delete frame_canvas;
+  } else if (canvas) {
+    ret = demo->overlay->end (dst_frame, out, src_frame);
+  }
   //GST_TRACE("dst_frame: %d,%d,%d", dst_frame->info.w, dst_frame->info.h, dst_frame->info.stride);
   return 0;
 }
@@ -218,6 +1572,106 @@ deinterlace_get_type (void)
   return deinterlace_type;
 }
 
+static GType
+overlay_mode_get_type (void)
+{
+  static GType overlay_mode_type = 0;
+
+  if (!overlay_mode_type) {
+    static GEnumValue overlay_mode_values[] = {
+      {GstNnInferenceDemo::overlay_frame, "Draw into the video frame by CPU",         "frame"},
+      {GstNnInferenceDemo::overlay_plane, "Draw into an overlay plane blended by 2D", "plane"},
+      {0,                                 NULL,                                       NULL },
+    };
+
+    overlay_mode_type =
+      g_enum_register_static("OverlayMode", overlay_mode_values);
+  }
+
+  return overlay_mode_type;
+}
+
+static GType
+qos_level_get_type (void)
+{
+  static GType qos_level_type = 0;
+
+  if (!qos_level_type) {
+    static GEnumValue qos_level_values[] = {
+      {GstNnInferenceDemo::qos_level_none,           "Full processing",                     "none"},
+      {GstNnInferenceDemo::qos_level_skip_inference, "Inference on part of the frames",     "skip-inference"},
+      {GstNnInferenceDemo::qos_level_reduce_drawing, "Skip inference and stats drawing",    "reduce-drawing"},
+      {GstNnInferenceDemo::qos_level_drop_frames,    "Skip inference, stats and frames",    "drop-frames"},
+      {0,                                            NULL,                                  NULL },
+    };
+
+    qos_level_type =
+      g_enum_register_static("QosLevel", qos_level_values);
+  }
+
+  return qos_level_type;
+}
+
+static GType
+inference_mode_get_type (void)
+{
+  static GType inference_mode_type = 0;
+
+  if (!inference_mode_type) {
+    static GEnumValue inference_mode_values[] = {
+      {GstNnInferenceDemo::inference_sync,   "Inference on every frame, in the streaming thread", "sync"},
+      {GstNnInferenceDemo::inference_latest, "Inference on the latest frame, in a worker thread", "latest"},
+      {GstNnInferenceDemo::inference_offline, "Inference on every frame, by model replicas in parallel", "offline"},
+      {GstNnInferenceDemo::inference_hetero, "Inference on the backend and on CPU, whichever finishes first", "hetero"},
+      {0,                                    NULL,                                                NULL },
+    };
+
+    inference_mode_type =
+      g_enum_register_static("InferenceMode", inference_mode_values);
+  }
+
+  return inference_mode_type;
+}
+
+static GType
+startup_get_type (void)
+{
+  static GType startup_type = 0;
+
+  if (!startup_type) {
+    static GEnumValue startup_values[] = {
+      {GstNnInferenceDemo::startup_wait,        "Hold the first frame until the model is ready",  "wait"},
+      {GstNnInferenceDemo::startup_passthrough, "Forward frames without results until then",      "passthrough"},
+      {0,                                       NULL,                                             NULL },
+    };
+
+    startup_type =
+      g_enum_register_static("StartupPolicy", startup_values);
+  }
+
+  return startup_type;
+}
+
+static GType
+sched_policy_get_type (void)
+{
+  static GType sched_policy_type = 0;
+
+  if (!sched_policy_type) {
+    static GEnumValue sched_policy_values[] = {
+      {GstNnInferenceDemo::sched_other, "Default time-sharing (SCHED_OTHER)", "other"},
+      {GstNnInferenceDemo::sched_fifo,  "Real-time FIFO (SCHED_FIFO)",        "fifo"},
+      {GstNnInferenceDemo::sched_rr,    "Real-time round-robin (SCHED_RR)",   "rr"},
+      {0,                               NULL,                                 NULL },
+    };
+
+    sched_policy_type =
+      g_enum_register_static("SchedPolicy", sched_policy_values);
+  }
+
+  return sched_policy_type;
+}
+
 static GType
 demo_mode_get_type (void)
 {
@@ -228,6 +1682,9 @@ demo_mode_get_type (void)
       {GstNnInferenceDemo::tflite_posenet,       "TensorFlow Lite Posenet",       "posenet"},
       {GstNnInferenceDemo::tflite_mobilenet_ssd, "TensorFlow Lite Mobilenet SSD", "mobilenet-ssd"},
       {GstNnInferenceDemo::tflite_benchmark,     "TensorFlow Lite Benchmark",     "benchmark"},
+      {GstNnInferenceDemo::tflite_cascade,       "TensorFlow Lite Cascade",       "cascade"},
+      {GstNnInferenceDemo::tflite_classifier,    "TensorFlow Lite Classifier",    "classifier"},
+      {GstNnInferenceDemo::tflite_segmentation,  "TensorFlow Lite Segmentation",  "segmentation"},
       {0,                                        NULL,                            NULL },
     };
 
@@ -259,14 +1716,68 @@ set_property (
       break;
     case PROP_DEMO_MODE:
       demo->demo_mode = (GstNnInferenceDemo::DemoMode)g_value_get_enum (value);
+      reload_start (demo, FALSE);
       break;
     case PROP_MODEL:
       g_free (demo->model);
       demo->model = g_value_dup_string (value);
+      reload_start (demo, FALSE);
       break;
     case PROP_LABEL:
       g_free (demo->label);
       demo->label = g_value_dup_string (value);
+      reload_start (demo, FALSE);
+      break;
+    case PROP_SECONDARY_MODEL:
+      g_free (demo->secondary_model);
+      demo->secondary_model = g_value_dup_string (value);
+      reload_start (demo, FALSE);
+      break;
+    case PROP_CASCADE_LABEL:
+      demo->cascade_label = g_value_get_int (value);
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference &&
+          demo->inference_demo_mode == GstNnInferenceDemo::tflite_cascade)
+        ((cascade_t *) demo->inference)->set_crop_label (demo->cascade_label);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_CASCADE_MAX_CROPS:
+      demo->cascade_max_crops = g_value_get_int (value);
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference &&
+          demo->inference_demo_mode == GstNnInferenceDemo::tflite_cascade)
+        ((cascade_t *) demo->inference)->set_max_crops (demo->cascade_max_crops);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_CLASSIFIER_TOP_K:
+      demo->classifier_top_k = g_value_get_int (value);
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference &&
+          demo->inference_demo_mode == GstNnInferenceDemo::tflite_classifier)
+        ((classifier_t *) demo->inference)->set_top_k (demo->classifier_top_k);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_CLASSIFIER_SMOOTHING:
+      demo->classifier_smoothing = g_value_get_float (value);
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference &&
+          demo->inference_demo_mode == GstNnInferenceDemo::tflite_classifier)
+        ((classifier_t *) demo->inference)->set_smoothing (demo->classifier_smoothing);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_CPU_POOL_THREADS:
+      cpu_pool_set_threads (demo, g_value_get_int (value));
+      g_mutex_lock (&demo->inference_lock);
+      if (*demo->cpu_pool)
+        cpu_pool_apply (demo);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_CPU_POOL_AFFINITY:
+      cpu_pool_set_affinity (demo, g_value_get_string (value));
+      g_mutex_lock (&demo->inference_lock);
+      if (*demo->cpu_pool)
+        cpu_pool_apply (demo);
+      g_mutex_unlock (&demo->inference_lock);
       break;
     case PROP_DISPLAY_STATS:
       demo->display_stats = g_value_get_boolean (value);
@@ -276,9 +1787,69 @@ set_property (
       break;
     case PROP_USE_NNAPI:
       demo->use_nnapi = g_value_get_int (value);
+      reload_start (demo, FALSE);
       break;
     case PROP_NUM_THREADS:
       demo->num_threads = g_value_get_int (value);
+      /* taken at the next inference, no need to re-create the interpreter.
+       * The autotuner goes on from there */
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference)
+        demo->inference->set_num_threads (demo->num_threads);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_AUTOTUNE_THREADS:
+      demo->autotune_threads = g_value_get_boolean (value);
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference)
+        demo->inference->set_autotune (demo->autotune_threads);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    /* taken by the running model before its next run, no need to
+     * re-create the interpreter */
+    case PROP_CPU_AFFINITY:
+      g_free (demo->cpu_affinity);
+      demo->cpu_affinity = g_value_dup_string (value);
+      demo->cpu_affinity_set = TRUE;
+      g_mutex_lock (&demo->inference_lock);
+      apply_thread_policy (demo);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_SCHED_POLICY:
+      demo->sched_policy = (GstNnInferenceDemo::SchedPolicy)g_value_get_enum (value);
+      demo->sched_policy_set = TRUE;
+      g_mutex_lock (&demo->inference_lock);
+      apply_thread_policy (demo);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_SCHED_PRIORITY:
+      demo->sched_priority = g_value_get_int (value);
+      demo->sched_policy_set = TRUE;
+      g_mutex_lock (&demo->inference_lock);
+      apply_thread_policy (demo);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_OVERLAY_MODE:
+      demo->overlay_mode = (GstNnInferenceDemo::OverlayMode)g_value_get_enum (value);
+      break;
+    case PROP_INFERENCE_MODE:
+      demo->inference_mode = (GstNnInferenceDemo::InferenceMode)g_value_get_enum (value);
+      break;
+    case PROP_INFERENCE_INTERVAL:
+      demo->inference_interval = g_value_get_uint (value);
+      break;
+    case PROP_REPLICAS:
+      demo->replicas = g_value_get_uint (value);
+      break;
+    case PROP_STARTUP:
+      demo->startup = (GstNnInferenceDemo::StartupPolicy)g_value_get_enum (value);
+      break;
+    case PROP_QOS_SHEDDING:
+      GST_OBJECT_LOCK (demo);
+      demo->qos_shedding = g_value_get_boolean (value);
+      if (!demo->qos_shedding)
+        demo->qos_level = GstNnInferenceDemo::qos_level_none;
+      GST_OBJECT_UNLOCK (demo);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -298,6 +1869,7 @@ get_property (
 {
   GstNnInferenceDemo *demo = (GstNnInferenceDemo *) (object);
   Imx2DDevice *device = demo->device;
+  unsigned long paddr_hits, paddr_misses;
 
   if (!device)
     return;
@@ -312,8 +1884,33 @@ get_property (
     case PROP_MODEL:
       g_value_set_string (value, demo->model);
       break;
-    case PROP_LABEL:
-      g_value_set_string (value, demo->label);
+    case PROP_LABEL:
+      g_value_set_string (value, demo->label);
+      break;
+    case PROP_SECONDARY_MODEL:
+      g_value_set_string (value, demo->secondary_model);
+      break;
+    case PROP_CASCADE_LABEL:
+      g_value_set_int (value, demo->cascade_label);
+      break;
+    case PROP_CASCADE_MAX_CROPS:
+      g_value_set_int (value, demo->cascade_max_crops);
+      break;
+    case PROP_CLASSIFIER_TOP_K:
+      g_value_set_int (value, demo->classifier_top_k);
+      break;
+    case PROP_CLASSIFIER_SMOOTHING:
+      g_value_set_float (value, demo->classifier_smoothing);
+      break;
+    case PROP_CPU_POOL_THREADS:
+      G_LOCK (cpu_pool);
+      g_value_set_int (value, cpu_pool_threads);
+      G_UNLOCK (cpu_pool);
+      break;
+    case PROP_CPU_POOL_AFFINITY:
+      G_LOCK (cpu_pool);
+      g_value_set_string (value, cpu_pool_affinity);
+      G_UNLOCK (cpu_pool);
       break;
     case PROP_DISPLAY_STATS:
       g_value_set_boolean (value, demo->display_stats);
@@ -324,8 +1921,84 @@ get_property (
     case PROP_USE_NNAPI:
       g_value_set_int (value, demo->use_nnapi);
       break;
-    case PROP_NUM_THREADS:
-      g_value_set_int (value, demo->num_threads);
+    case PROP_NUM_THREADS: {
+      /* the autotuner may have changed it */
+      gint num_threads = -1;
+      g_mutex_lock (&demo->inference_lock);
+      if (demo->inference)
+        num_threads = demo->inference->get_num_threads ();
+      g_mutex_unlock (&demo->inference_lock);
+      g_value_set_int (value, num_threads > 0 ? num_threads : demo->num_threads);
+      break;
+    }
+    case PROP_AUTOTUNE_THREADS:
+      g_value_set_boolean (value, demo->autotune_threads);
+      break;
+    case PROP_CPU_AFFINITY:
+      g_value_set_string (value, demo->cpu_affinity);
+      break;
+    case PROP_SCHED_POLICY:
+      g_value_set_enum (value, demo->sched_policy);
+      break;
+    case PROP_SCHED_PRIORITY:
+      g_value_set_int (value, demo->sched_priority);
+      break;
+    case PROP_OVERLAY_MODE:
+      g_value_set_enum (value, demo->overlay_mode);
+      break;
+    case PROP_QOS_SHEDDING:
+      g_value_set_boolean (value, demo->qos_shedding);
+      break;
+    case PROP_QOS_LEVEL:
+      GST_OBJECT_LOCK (demo);
+      g_value_set_enum (value, demo->qos_level);
+      GST_OBJECT_UNLOCK (demo);
+      break;
+    case PROP_INFERENCE_MODE:
+      g_value_set_enum (value, demo->inference_mode);
+      break;
+    case PROP_INFERENCE_INTERVAL:
+      g_value_set_uint (value, demo->inference_interval);
+      break;
+    case PROP_REPLICAS:
+      g_value_set_uint (value, demo->replicas);
+      break;
+    case PROP_STARTUP:
+      g_value_set_enum (value, demo->startup);
+      break;
+    case PROP_STARTUP_STATS:
+      GST_OBJECT_LOCK (demo);
+      g_value_take_boxed (value, gst_structure_new ("startup-stats",
+          "first-frame", G_TYPE_UINT64, (guint64) demo->first_frame_time,
+          "first-result", G_TYPE_UINT64, (guint64) demo->first_result_time,
+          NULL));
+      GST_OBJECT_UNLOCK (demo);
+      break;
+    case PROP_LATENCY_STATS:
+      g_mutex_lock (&demo->inference_lock);
+      GST_OBJECT_LOCK (demo);
+      g_value_take_boxed (value, gst_structure_new ("latency-stats",
+          "processing", G_TYPE_UINT64, (guint64) demo->processing_latency,
+          "held", G_TYPE_UINT64, (guint64) demo->hold_latency,
+          "capture-to-output", G_TYPE_UINT64, (guint64) demo->capture_latency,
+          "capture-to-output-max", G_TYPE_UINT64, (guint64) demo->capture_latency_max,
+          "inference", G_TYPE_DOUBLE, demo->inference_worker ?
+              demo->inference_worker->get_latency () :
+              (demo->inference ? demo->inference->inference_time_cur_.load () : 0.0),
+          "discarded", G_TYPE_UINT64, demo->inference_discarded_count,
+          NULL));
+      GST_OBJECT_UNLOCK (demo);
+      g_mutex_unlock (&demo->inference_lock);
+      break;
+    case PROP_INPUT_STATS:
+      phy_addr_cache_get_stats (&paddr_hits, &paddr_misses);
+      g_value_take_boxed (value, gst_structure_new ("input-stats",
+          "direct", G_TYPE_UINT64, demo->in_direct_count,
+          "imported", G_TYPE_UINT64, demo->in_imported_count,
+          "copied", G_TYPE_UINT64, demo->in_copied_count,
+          "paddr-cache-hits", G_TYPE_UINT64, (guint64) paddr_hits,
+          "paddr-cache-misses", G_TYPE_UINT64, (guint64) paddr_misses,
+          NULL));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -344,6 +2017,24 @@ finalize (
   UNREF_BUFFER (demo->in_buf);
   UNREF_POOL (demo->in_pool);
   UNREF_POOL (demo->self_out_pool);
+  GST_INFO ("input frames: direct %" G_GUINT64_FORMAT ", imported %"
+      G_GUINT64_FORMAT ", copied %" G_GUINT64_FORMAT, demo->in_direct_count,
+      demo->in_imported_count, demo->in_copied_count);
+  GST_INFO ("frames dropped by QoS: %" G_GUINT64_FORMAT
+      ", inference requests discarded: %" G_GUINT64_FORMAT,
+      demo->qos_dropped_count, demo->inference_discarded_count);
+  GST_INFO ("infer_sink frames matched: %" G_GUINT64_FORMAT
+      ", missed: %" G_GUINT64_FORMAT,
+      demo->infer_matched_count, demo->infer_missed_count);
+  if (demo->overlay) {
+    /* releases its buffer to the allocator */
+    delete demo->overlay;
+    demo->overlay = NULL;
+  }
+  if (demo->mask_layer) {
+    delete demo->mask_layer;
+    demo->mask_layer = NULL;
+  }
   if (demo->allocator) {
     gst_object_unref (demo->allocator);
     demo->allocator = NULL;
@@ -358,15 +2049,200 @@ finalize (
 
   g_free (demo->model);
   g_free (demo->label);
-
+  g_free (demo->secondary_model);
+  g_free (demo->cpu_affinity);
+
+  reload_stop (demo);
+  if (demo->replica_pool) {
+    offline_flush (demo);
+    delete demo->replica_pool;
+    demo->replica_pool = NULL;
+  }
+  delete demo->offline_frames;
+  delete demo->replica_inferences;
+  infer_clear (demo);
+  delete demo->infer_buffers;
+  g_mutex_clear (&demo->infer_lock);
+  if (demo->inference_worker) {
+    delete demo->inference_worker;
+    demo->inference_worker = NULL;
+  }
   if (demo->inference) {
     delete demo->inference;
     demo->inference = NULL;
   }
+  /* after the inference objects, they share it */
+  delete demo->cpu_pool;
+  g_mutex_clear (&demo->inference_lock);
+  g_cond_clear (&demo->reload_cond);
 
   G_OBJECT_CLASS (parent_class)->finalize ((GObject *) (demo));
 }
 
+static void
+qos_update (
+  GstNnInferenceDemo *demo,
+  GstEvent *event)
+{
+  GstQOSType type;
+  gdouble proportion;
+  GstClockTimeDiff diff;
+  GstClockTime timestamp;
+  gint level, new_level;
+
+  gst_event_parse_qos (event, &type, &proportion, &diff, &timestamp);
+
+  GST_OBJECT_LOCK (demo);
+  if (!demo->qos_shedding) {
+    GST_OBJECT_UNLOCK (demo);
+    return;
+  }
+  demo->qos_proportion = QOS_SMOOTHING * proportion +
+      (1.0 - QOS_SMOOTHING) * demo->qos_proportion;
+
+  /* one step at a time, so each level gets a chance to catch up */
+  level = new_level = demo->qos_level;
+  if ((level < GstNnInferenceDemo::qos_level_drop_frames) &&
+      (demo->qos_proportion > qos_raise_threshold[level]))
+    new_level++;
+  else if ((level > GstNnInferenceDemo::qos_level_none) &&
+      (demo->qos_proportion < qos_raise_threshold[level - 1] - QOS_HYSTERESIS))
+    new_level--;
+  demo->qos_level = (GstNnInferenceDemo::QosLevel) new_level;
+  GST_OBJECT_UNLOCK (demo);
+
+  GST_LOG_OBJECT (demo, "QoS proportion %f (smoothed %f), diff %" G_GINT64_FORMAT,
+      proportion, demo->qos_proportion, diff);
+  if (new_level != level) {
+    GST_INFO_OBJECT (demo, "QoS level %d -> %d", level, new_level);
+    g_object_notify (G_OBJECT (demo), "qos-level");
+  }
+}
+
+/* per frame load shedding decision, returns TRUE to drop the frame */
+static gboolean
+qos_shed_frame (
+  GstNnInferenceDemo *demo)
+{
+  gint level;
+  guint interval;
+  guint64 count = demo->qos_frame_count++;
+
+  GST_OBJECT_LOCK (demo);
+  level = demo->qos_level;
+  GST_OBJECT_UNLOCK (demo);
+
+  interval = demo->inference_interval;
+  if (level >= GstNnInferenceDemo::qos_level_skip_inference)
+    interval *= QOS_INFERENCE_INTERVAL;
+  demo->qos_run_inference = demo->enable_inference &&
+      (count % interval) == 0;
+  demo->qos_draw_stats = demo->display_stats &&
+      (level < GstNnInferenceDemo::qos_level_reduce_drawing);
+
+  if ((level >= GstNnInferenceDemo::qos_level_drop_frames) && (count & 1)) {
+    demo->qos_dropped_count++;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/* latest-frame mode: a frame arriving while the model is busy is not queued,
+ * it is shown with the last results */
+static void
+latest_frame_update (
+  GstNnInferenceDemo *demo)
+{
+  if (demo->qos_run_inference && demo->inference_worker &&
+      demo->inference_worker->busy ()) {
+    demo->qos_run_inference = FALSE;
+    demo->inference_discarded_count++;
+  }
+}
+
+static void
+latency_update (
+  GstNnInferenceDemo *demo,
+  GstBuffer *buf,
+  gint64 start_time)
+{
+  GstClockTime processing = (g_get_monotonic_time () - start_time) * GST_USECOND;
+  GstClockTime running_time, now;
+  GstClock *clock;
+  gboolean post = FALSE;
+
+  running_time = gst_segment_to_running_time (&GST_BASE_TRANSFORM (demo)->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+  clock = gst_element_get_clock (GST_ELEMENT (demo));
+
+  GST_OBJECT_LOCK (demo);
+  if (demo->processing_latency == 0)
+    demo->processing_latency = processing;
+  else
+    demo->processing_latency = LATENCY_SMOOTHING * processing +
+        (1.0 - LATENCY_SMOOTHING) * demo->processing_latency;
+  if (demo->processing_latency + demo->hold_latency >
+      LATENCY_MARGIN * demo->reported_latency) {
+    demo->reported_latency = demo->processing_latency + demo->hold_latency;
+    post = TRUE;
+  }
+
+  if (clock && GST_CLOCK_TIME_IS_VALID (running_time)) {
+    now = gst_clock_get_time (clock) - GST_ELEMENT_CAST (demo)->base_time;
+    if (now > running_time) {
+      GstClockTime latency = now - running_time;
+      demo->capture_latency = (demo->capture_latency == 0) ? latency :
+          LATENCY_SMOOTHING * latency + (1.0 - LATENCY_SMOOTHING) * demo->capture_latency;
+      demo->capture_latency_max = MAX (demo->capture_latency_max, latency);
+    }
+  }
+  GST_OBJECT_UNLOCK (demo);
+
+  if (clock)
+    gst_object_unref (clock);
+
+  if (post) {
+    GST_DEBUG_OBJECT (demo, "processing latency now %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (demo->reported_latency));
+    gst_element_post_message (GST_ELEMENT (demo),
+        gst_message_new_latency (GST_OBJECT (demo)));
+  }
+}
+
+static gboolean
+transform_query (
+  GstBaseTransform * transform,
+  GstPadDirection direction,
+  GstQuery * query)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) (transform);
+  gboolean ret;
+
+  ret = GST_BASE_TRANSFORM_CLASS (parent_class)->query (transform, direction, query);
+
+  if (ret && (direction == GST_PAD_SRC) &&
+      (GST_QUERY_TYPE (query) == GST_QUERY_LATENCY)) {
+    gboolean live;
+    GstClockTime min, max, latency;
+
+    gst_query_parse_latency (query, &live, &min, &max);
+    GST_OBJECT_LOCK (demo);
+    /* frames held in offline and hetero modes leave later */
+    latency = demo->processing_latency + demo->hold_latency;
+    demo->reported_latency = latency;
+    GST_OBJECT_UNLOCK (demo);
+
+    min += latency;
+    if (GST_CLOCK_TIME_IS_VALID (max))
+      max += latency;
+    GST_DEBUG_OBJECT (demo, "latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+    gst_query_set_latency (query, live, min, max);
+  }
+
+  return ret;
+}
+
 static gboolean
 src_event (
   GstBaseTransform * transform,
@@ -402,6 +2278,9 @@ src_event (
         }
       }
       break;
+    case GST_EVENT_QOS:
+      qos_update ((GstNnInferenceDemo *) transform, event);
+      break;
     default:
       break;
   }
@@ -409,6 +2288,25 @@ src_event (
   return GST_BASE_TRANSFORM_CLASS (parent_class)->src_event(transform, event);
 }
 
+static gboolean
+sink_event (
+  GstBaseTransform * transform,
+  GstEvent * event)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) transform;
+
+  /* the frames held in offline mode go out before what follows them in
+   * the stream: EOS, a new segment or new caps. Drawing them still needs
+   * the segment they came with */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    offline_flush (demo);
+  else if (GST_EVENT_IS_SERIALIZED (event) && demo->replica_pool &&
+      !demo->offline_frames->empty () && offline_push (demo, TRUE, NULL) != GST_FLOW_OK)
+    offline_flush (demo);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event(transform, event);
+}
+
 static GstCaps *
 transform_caps(
   GstBaseTransform * transform,
@@ -1210,6 +3108,9 @@ propose_allocation (
     } else {
       return FALSE;
     }
+  } else if (demo->allocator) {
+    /* upstream allocates itself, still offer physically contiguous memory */
+    gst_query_add_allocation_param (query, demo->allocator, NULL);
   }
 
   gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
@@ -1323,6 +3224,7 @@ set_info (
   Imx2DDevice *device = demo->device;
   GstStructure *ins, *outs;
   const gchar *from_interlace;
+  gboolean failed;
 
   if (!device)
     return FALSE;
@@ -1337,12 +3239,29 @@ set_info (
           || g_strcmp0(from_interlace, "mixed") == 0)) {
   }
 
-  if (IMX_2D_ROTATION_0 != demo->rotate)
+  if (IMX_2D_ROTATION_0 != demo->rotate) {
+    gst_base_transform_set_passthrough((GstBaseTransform*)filter, FALSE);
+    gst_base_transform_set_in_place((GstBaseTransform*)filter, FALSE);
+  } else if (gst_caps_is_equal(in, out)) {
+    /* nothing to convert, run inference and draw on the incoming buffer */
+    GST_DEBUG ("same caps, processing in place");
     gst_base_transform_set_passthrough((GstBaseTransform*)filter, FALSE);
+    gst_base_transform_set_in_place((GstBaseTransform*)filter, TRUE);
+  } else {
+    gst_base_transform_set_in_place((GstBaseTransform*)filter, FALSE);
+  }
 
   GST_DEBUG ("set info from %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, in, out);
 
-  if (nninferencedemo_init(demo) != 0) {
+  /* the model does not depend on the caps, keep it across renegotiations,
+   * model changes are swapped in by reload_swap(). It normally is being
+   * built since READY to PAUSED */
+  if (!demo->inference && demo->startup == GstNnInferenceDemo::startup_wait)
+    reload_wait (demo);
+  g_mutex_lock (&demo->inference_lock);
+  failed = !demo->inference && demo->reload_failed;
+  g_mutex_unlock (&demo->inference_lock);
+  if (failed) {
     GST_ERROR ("Could not initialize NN Inference demo.");
     return FALSE;
   }
@@ -1366,8 +3285,175 @@ _set_cached_phyaddr (
                 g_quark_from_static_string ("phyaddr"), phyadd, NULL);
 }
 
+static void
+_dmabuf_fd_released (
+  gpointer data)
+{
+  phy_addr_cache_invalidate (GPOINTER_TO_INT (data) - 1);
+}
+
+/* the fd of a dmabuf memory, dropped from the physical address cache when
+ * the memory is freed: the cache is keyed by fd and, before Linux 5.3, all
+ * dmabufs share one inode, so a reused fd would hit a stale entry */
+static gint
+_get_dmabuf_fd (
+  GstMemory * mem)
+{
+  gint fd = gst_dmabuf_memory_get_fd (mem);
+
+  if (fd >= 0 && !gst_mini_object_get_qdata (GST_MINI_OBJECT (mem), DMABUF_FD_QUARK))
+    gst_mini_object_set_qdata (GST_MINI_OBJECT (mem), DMABUF_FD_QUARK,
+        GINT_TO_POINTER (fd + 1), _dmabuf_fd_released);
+  return fd;
+}
+
+/* import a virtual memory frame if it is physically contiguous, with the
+ * default plane layout as G2D derives plane addresses from the width */
+static gboolean
+import_input_frame (
+  GstVideoFrame *in,
+  PhyMemBlock *mem)
+{
+  GstVideoInfo info;
+  GstMemory *gmem;
+  guint i;
+
+  if (gst_buffer_n_memory (in->buffer) != 1)
+    return FALSE;
+
+  gmem = gst_buffer_peek_memory (in->buffer, 0);
+  if (gst_mini_object_get_qdata (GST_MINI_OBJECT (gmem), NO_PHYADDR_QUARK))
+    return FALSE;
+
+  gst_video_info_set_format (&info, GST_VIDEO_FRAME_FORMAT (in),
+      GST_VIDEO_FRAME_WIDTH (in), GST_VIDEO_FRAME_HEIGHT (in));
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (in); i++) {
+    if ((info.offset[i] != in->info.offset[i]) ||
+        (info.stride[i] != in->info.stride[i]))
+      return FALSE;
+  }
+
+  mem->vaddr = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (in, 0);
+  mem->size = info.size;
+  mem->paddr = _get_cached_phyaddr (gmem);
+  if (!mem->paddr)
+    mem->paddr = (guint8 *) phy_addr_from_vaddr (mem->vaddr, PAGE_ALIGN (mem->size));
+  if (!mem->paddr) {
+    /* don't try again for this memory */
+    gst_mini_object_set_qdata (GST_MINI_OBJECT (gmem), NO_PHYADDR_QUARK,
+        GINT_TO_POINTER (1), NULL);
+    return FALSE;
+  }
+  _set_cached_phyaddr (gmem, mem->paddr);
+
+  return TRUE;
+}
+
+/* multithreaded, stride aware copy, each plane is split in bands of rows */
+static void
+copy_input_frame (
+  GstNnInferenceDemo *demo,
+  GstVideoFrame *dest,
+  GstVideoFrame *src)
+{
+  guint n_planes = GST_VIDEO_FRAME_N_PLANES (src);
+
+  if (GST_VIDEO_FORMAT_INFO_IS_TILED (src->info.finfo)) {
+    gst_video_frame_copy (dest, src);
+    return;
+  }
+
+  g_mutex_lock (&demo->inference_lock);
+  std::shared_ptr<worker_pool_t> pool = cpu_pool_get (demo);
+  g_mutex_unlock (&demo->inference_lock);
+
+  pool->run (n_planes * COPY_SLICES_PER_PLANE, [&] (int job) {
+    guint plane = job / COPY_SLICES_PER_PLANE;
+    gint slice = job % COPY_SLICES_PER_PLANE;
+    gint rows = GST_VIDEO_FRAME_COMP_HEIGHT (src, plane);
+    gint row_bytes = GST_VIDEO_FRAME_COMP_WIDTH (src, plane) *
+        GST_VIDEO_FRAME_COMP_PSTRIDE (src, plane);
+    gint first = rows * slice / COPY_SLICES_PER_PLANE;
+    gint last = rows * (slice + 1) / COPY_SLICES_PER_PLANE;
+    gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (src, plane);
+    gint dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dest, plane);
+
+    utils::copy_plane (
+        (uint8_t *) GST_VIDEO_FRAME_PLANE_DATA (dest, plane) + first * dest_stride,
+        dest_stride,
+        (const uint8_t *) GST_VIDEO_FRAME_PLANE_DATA (src, plane) + first * src_stride,
+        src_stride,
+        row_bytes,
+        last - first);
+  });
+}
+
+/* returns in, or a copy of in into physically contiguous memory.
+ * If in is virtual memory imported as is, *imported is set and mem holds
+ * its addresses */
+static GstVideoFrame *
+get_phy_input_frame (
+  GstNnInferenceDemo *demo,
+  GstVideoFrame *in,
+  GstVideoFrame *temp_in_frame,
+  PhyMemBlock *mem,
+  gboolean *imported)
+{
+  GstCaps *caps;
+  GstVideoInfo info;
+
+  *imported = FALSE;
+  if (gst_buffer_is_phymem(in->buffer)
+      || gst_is_dmabuf_memory (gst_buffer_peek_memory (in->buffer, 0))) {
+    demo->in_direct_count++;
+    return in;
+  }
+
+  if (import_input_frame (in, mem)) {
+    GST_TRACE ("imported input frame, paddr %p", mem->paddr);
+    demo->in_imported_count++;
+    *imported = TRUE;
+    return in;
+  }
+
+  GST_DEBUG ("copy input frame to physical continues memory");
+  caps = gst_video_info_to_caps(&in->info);
+  gst_video_info_from_caps(&info, caps); //update the size info
+
+  if (!demo->in_pool ||
+      !buffer_pool_is_ok(demo->in_pool, caps,info.size)) {
+    UNREF_POOL(demo->in_pool);
+    GST_DEBUG_OBJECT(demo, "creating new input pool");
+    demo->in_pool = create_bufferpool(demo, caps,
+        info.size, 1, IN_POOL_MAX_BUFFERS);
+  }
+
+  gst_caps_unref (caps);
+
+  if (demo->in_pool && !demo->in_buf) {
+    gst_buffer_pool_set_active(demo->in_pool, TRUE);
+    GstFlowReturn ret = gst_buffer_pool_acquire_buffer(demo->in_pool,
+                                                &(demo->in_buf), NULL);
+    if (ret != GST_FLOW_OK)
+      GST_ERROR("error acquiring input buffer: %s", gst_flow_get_name(ret));
+    else
+      GST_LOG ("created input buffer (%p)", demo->in_buf);
+  }
+
+  if (demo->in_buf) {
+    gst_video_frame_map(temp_in_frame, &info, demo->in_buf, GST_MAP_WRITE);
+    copy_input_frame(demo, temp_in_frame, in);
+    gst_video_frame_unmap(temp_in_frame);
+    demo->in_copied_count++;
+    return temp_in_frame;
+  }
+
+  GST_ERROR ("Can't get input buffer");
+  return NULL;
+}
+
 static GstFlowReturn
-transform_frame(
+convert_frame(
   GstVideoFilter *filter,
   GstVideoFrame *in,
   GstVideoFrame *out)
@@ -1385,10 +3471,17 @@ transform_frame(
   GstVideoInfo info;
   GstDmabufMeta *dmabuf_meta;
   gint64 drm_modifier = 0;
+  gboolean imported;
+  gboolean input_ready = FALSE;
+  gboolean pending = FALSE;
 
   if (!device)
     return GST_FLOW_ERROR;
 
+  if (qos_shed_frame (demo))
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  latest_frame_update (demo);
+
   if (!(gst_buffer_is_phymem(out->buffer)
         || gst_is_dmabuf_memory (gst_buffer_peek_memory (out->buffer, 0)))) {
     GST_ERROR ("out buffer is not phy memory or DMA Buf");
@@ -1396,42 +3489,9 @@ transform_frame(
   }
 
   /* Check if need copy input frame */
-  if (!(gst_buffer_is_phymem(in->buffer)
-        || gst_is_dmabuf_memory (gst_buffer_peek_memory (in->buffer, 0)))) {
-    GST_DEBUG ("copy input frame to physical continues memory");
-    caps = gst_video_info_to_caps(&in->info);
-    gst_video_info_from_caps(&info, caps); //update the size info
-
-    if (!demo->in_pool ||
-        !buffer_pool_is_ok(demo->in_pool, caps,info.size)) {
-      UNREF_POOL(demo->in_pool);
-      GST_DEBUG_OBJECT(demo, "creating new input pool");
-      demo->in_pool = create_bufferpool(demo, caps,
-          info.size, 1, IN_POOL_MAX_BUFFERS);
-    }
-
-    gst_caps_unref (caps);
-
-    if (demo->in_pool && !demo->in_buf) {
-      gst_buffer_pool_set_active(demo->in_pool, TRUE);
-      GstFlowReturn ret = gst_buffer_pool_acquire_buffer(demo->in_pool,
-                                                  &(demo->in_buf), NULL);
-      if (ret != GST_FLOW_OK)
-        GST_ERROR("error acquiring input buffer: %s", gst_flow_get_name(ret));
-      else
-        GST_LOG ("created input buffer (%p)", demo->in_buf);
-    }
-
-    if (demo->in_buf) {
-      gst_video_frame_map(&temp_in_frame, &info, demo->in_buf, GST_MAP_WRITE);
-      gst_video_frame_copy(&temp_in_frame, in);
-      input_frame = &temp_in_frame;
-      gst_video_frame_unmap(&temp_in_frame);
-    } else {
-      GST_ERROR ("Can't get input buffer");
-      return GST_FLOW_ERROR;
-    }
-  }
+  input_frame = get_phy_input_frame (demo, in, &temp_in_frame, &src_mem, &imported);
+  if (!input_frame)
+    return GST_FLOW_ERROR;
 
   if (demo->pool_config_update) {
     //alignment check
@@ -1538,11 +3598,13 @@ transform_frame(
     return GST_FLOW_ERROR;
 
   src.fd[0] = src.fd[1] = src.fd[2] = src.fd[3] = -1;
-  if (gst_is_dmabuf_memory (gst_buffer_peek_memory (input_frame->buffer, 0))) {
+  if (imported) {
+    src.mem = &src_mem;
+  } else if (gst_is_dmabuf_memory (gst_buffer_peek_memory (input_frame->buffer, 0))) {
     src.mem = &src_mem;
     n_mem = gst_buffer_n_memory (input_frame->buffer);
     for (i = 0; i < n_mem; i++)
-      src.fd[i] = gst_dmabuf_memory_get_fd (gst_buffer_peek_memory (input_frame->buffer, i));
+      src.fd[i] = _get_dmabuf_fd (gst_buffer_peek_memory (input_frame->buffer, i));
   } else
     src.mem = gst_buffer_query_phymem_block (input_frame->buffer);
   src.alpha = 0xFF;
@@ -1575,7 +3637,7 @@ transform_frame(
     dst.mem = &dst_mem;
     n_mem = gst_buffer_n_memory (out->buffer);
     for (i = 0; i < n_mem; i++)
-      dst.fd[i] = gst_dmabuf_memory_get_fd (gst_buffer_peek_memory (out->buffer, i));
+      dst.fd[i] = _get_dmabuf_fd (gst_buffer_peek_memory (out->buffer, i));
   } else
     dst.mem = gst_buffer_query_phymem_block (out->buffer);
   dst.alpha = 0xFF;
@@ -1605,11 +3667,32 @@ transform_frame(
   if (!dst.mem->paddr)
     dst.mem->paddr = _get_cached_phyaddr (gst_buffer_peek_memory (out->buffer, 0));
 
+  /* display convert and model input resize are queued back to back and
+   * waited for once. Async submission leaves the CPU free until
+   * nninference() has to touch the frames */
+  if (device->convert_async && device->wait) {
+    if (device->convert_async (device, &dst, &src) != 0)
+      return GST_FLOW_ERROR;
+    pending = TRUE;
+    if (demo->inference && demo->qos_run_inference &&
+        !replica_mode (demo->inference_mode) &&
+        !demo->inference->needs_source_frame () && !infer_available (demo)) {
+      Imx2DFrame model = {0};
+
+      if (demo->inference->setup_input_frame (info.width, info.height,
+            demo->rotate, &model) == 0
+          && device->config_output (device, &model.info) == 0
+          && device->convert_async (device, &model, &src) == 0)
+        input_ready = TRUE;
+      device->config_output (device, &dst.info);
+    }
+  }
+
   //convert
-  if (device->convert(device, &dst, &src) == 0) {
+  if (pending || input_ready || device->convert(device, &dst, &src) == 0) {
     GST_TRACE ("frame conversion done");
 
-    if (nninference((GObject*)demo, &info, &src, &dst) != 0) {
+    if (nninference((GObject*)demo, &info, &src, &dst, out, input_ready, pending) != 0) {
       return GST_FLOW_ERROR;
     }
 
@@ -1626,13 +3709,163 @@ transform_frame(
   return GST_FLOW_ERROR;
 }
 
+static GstFlowReturn
+process_frame_ip(
+  GstVideoFilter *filter,
+  GstVideoFrame *in)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *)(filter);
+  Imx2DDevice *device = demo->device;
+  GstVideoFrame *input_frame;
+  GstVideoFrame temp_in_frame;
+  Imx2DFrame src = {0};
+  PhyMemBlock src_mem = {0};
+  guint i, n_mem;
+  gboolean imported;
+
+  if (!device)
+    return GST_FLOW_ERROR;
+
+  if (qos_shed_frame (demo))
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  latest_frame_update (demo);
+
+  /* same caps and no rotation: no convert, the input is also the output */
+  input_frame = get_phy_input_frame (demo, in, &temp_in_frame, &src_mem, &imported);
+  if (!input_frame)
+    return GST_FLOW_ERROR;
+
+  src.info.fmt = GST_VIDEO_INFO_FORMAT(&(in->info));
+  src.info.w = in->info.width;
+  src.info.h = in->info.height;
+  src.info.stride = in->info.stride[0];
+
+  src.fd[0] = src.fd[1] = src.fd[2] = src.fd[3] = -1;
+  if (imported) {
+    src.mem = &src_mem;
+  } else if (gst_is_dmabuf_memory (gst_buffer_peek_memory (input_frame->buffer, 0))) {
+    src.mem = &src_mem;
+    n_mem = gst_buffer_n_memory (input_frame->buffer);
+    for (i = 0; i < n_mem; i++)
+      src.fd[i] = _get_dmabuf_fd (gst_buffer_peek_memory (input_frame->buffer, i));
+  } else
+    src.mem = gst_buffer_query_phymem_block (input_frame->buffer);
+  src.alpha = 0xFF;
+  src.interlace_type = IMX_2D_INTERLACE_PROGRESSIVE;
+  src.crop.x = 0;
+  src.crop.y = 0;
+  src.crop.w = in->info.width;
+  src.crop.h = in->info.height;
+  src.rotate = IMX_2D_ROTATION_0;
+
+  if (!src.mem->paddr)
+    src.mem->paddr = _get_cached_phyaddr (gst_buffer_peek_memory (input_frame->buffer, 0));
+  if (!src.mem->paddr && src.fd[0] >= 0) {
+    src.mem->paddr = (guint8*)phy_addr_from_fd_cached (src.fd[0]);
+    _set_cached_phyaddr (gst_buffer_peek_memory (input_frame->buffer, 0), src.mem->paddr);
+  }
+  if (!src.mem->paddr) {
+    GST_ERROR ("Can't get physical address.");
+    return GST_FLOW_ERROR;
+  }
+
+  /* in is also where the overlay plane and the mask are blended, unless
+   * src is a copy of it: then they would never reach the output, so
+   * nninference() draws by CPU only */
+  if (device->config_output(device, &src.info) != 0)
+    return GST_FLOW_ERROR;
+
+  if (nninference((GObject*)demo, &in->info, &src,
+        (input_frame == in) ? &src : NULL, in, FALSE, FALSE) != 0) {
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+transform_frame(
+  GstVideoFilter *filter,
+  GstVideoFrame *in,
+  GstVideoFrame *out)
+{
+  gint64 start_time = g_get_monotonic_time ();
+  GstFlowReturn ret;
+
+  ret = reload_swap ((GstNnInferenceDemo *) filter);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  ret = convert_frame (filter, in, out);
+
+  if (ret == GST_FLOW_OK) {
+    latency_update ((GstNnInferenceDemo *) filter, in->buffer, start_time);
+    startup_update ((GstNnInferenceDemo *) filter,
+        &((GstNnInferenceDemo *) filter)->first_frame_time, "first-frame");
+  }
+  if (ret == GST_FLOW_OK && ((GstNnInferenceDemo *) filter)->replica_pool)
+    ret = offline_queue ((GstNnInferenceDemo *) filter, out);
+  return ret;
+}
+
 static GstFlowReturn
 transform_frame_ip(
   GstVideoFilter *filter,
   GstVideoFrame *in)
 {
-  // FIXME: this is a temporary code. need to improve.
-  return transform_frame(filter, in, in);
+  gint64 start_time = g_get_monotonic_time ();
+  GstFlowReturn ret;
+
+  ret = reload_swap ((GstNnInferenceDemo *) filter);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  ret = process_frame_ip (filter, in);
+
+  if (ret == GST_FLOW_OK) {
+    latency_update ((GstNnInferenceDemo *) filter, in->buffer, start_time);
+    startup_update ((GstNnInferenceDemo *) filter,
+        &((GstNnInferenceDemo *) filter)->first_frame_time, "first-frame");
+  }
+  if (ret == GST_FLOW_OK && ((GstNnInferenceDemo *) filter)->replica_pool)
+    ret = offline_queue ((GstNnInferenceDemo *) filter, in);
+  return ret;
+}
+
+static GstStateChangeReturn
+change_state (
+  GstElement * element,
+  GstStateChange transition)
+{
+  GstNnInferenceDemo *demo = (GstNnInferenceDemo *) element;
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (demo);
+    demo->startup_time = g_get_monotonic_time ();
+    demo->first_frame_time = 0;
+    demo->first_result_time = 0;
+    GST_OBJECT_UNLOCK (demo);
+    /* load the model while upstream starts, instead of in set_info() */
+    reload_start (demo, TRUE);
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  /* streaming is stopped, the held frames won't be pushed */
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY && demo->replica_pool) {
+    offline_flush (demo);
+    delete demo->replica_pool;
+    demo->replica_pool = NULL;
+    g_mutex_lock (&demo->inference_lock);
+    replica_cancel (demo);
+    g_mutex_unlock (&demo->inference_lock);
+  }
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    g_mutex_lock (&demo->infer_lock);
+    gst_segment_init (&demo->infer_segment, GST_FORMAT_TIME);
+    g_mutex_unlock (&demo->infer_lock);
+    infer_clear (demo);
+  }
+  return ret;
 }
 
 static void
@@ -1688,6 +3921,10 @@ class_init (
   gst_element_class_add_pad_template (element_class,
       gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
 #endif
+  /* model sized stream for inference, see infer_load() */
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("infer_sink", GST_PAD_SINK, GST_PAD_REQUEST,
+          gst_caps_from_string (GST_VIDEO_CAPS_MAKE ("{ RGB, BGRx, BGRA }"))));
   klass->in_plugin = in_plugin;
 
   parent_class = (GstElementClass *)g_type_class_peek_parent (klass);
@@ -1696,6 +3933,23 @@ class_init (
   gobject_class->set_property = set_property;
   gobject_class->get_property = get_property;
 
+  /**
+   * nninferencedemo::reload:
+   *
+   * Build the model again from the current settings in the background and
+   * swap it in once loaded, the current model runs meanwhile. Setting
+   * demo-mode, model, label, secondary-model or use-nnapi while playing
+   * does the same. "nninferencedemo-reloaded" is posted once switched.
+   */
+  g_signal_new ("reload", G_TYPE_FROM_CLASS (klass),
+      (GSignalFlags)(G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+      G_STRUCT_OFFSET (GstNnInferenceDemoClass, reload),
+      NULL, NULL, NULL, G_TYPE_NONE, 0);
+  klass->reload = reload;
+  element_class->change_state = change_state;
+  element_class->request_new_pad = request_new_pad;
+  element_class->release_pad = release_pad;
+
   if (capabilities & IMX_2D_DEVICE_CAP_ROTATE) {
     g_object_class_install_property (gobject_class, PROP_OUTPUT_ROTATE,
         g_param_spec_enum("rotation", "Output rotation",
@@ -1726,16 +3980,124 @@ class_init (
 
   g_object_class_install_property (gobject_class, PROP_USE_NNAPI,
       g_param_spec_int("use-nnapi", "Use NNAPI",
-        "Use NNAPI",
-        0, 2, USE_NNAPI_DEFAULT,
+        "Inference backend: 0 CPU, 1 NNAPI, 2 vx-delegate, 3 XNNPACK",
+        0, 3, USE_NNAPI_DEFAULT,
         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
   g_object_class_install_property (gobject_class, PROP_NUM_THREADS,
       g_param_spec_int("num-threads", "Number of threads for inference",
-        "Number of threads for inference",
+        "Number of threads for inference, the starting point of "
+        "autotune-threads",
         1, 32, NUM_THREADS_DEFAULT,
         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+  g_object_class_install_property (gobject_class, PROP_AUTOTUNE_THREADS,
+      g_param_spec_boolean("autotune-threads", "Autotune number of threads",
+        "Periodically try the neighbouring thread counts, keep the fastest "
+        "and post an \"nninferencedemo-autotune\" element message. Starts "
+        "from num-threads, setting it restarts from the new count",
+        AUTOTUNE_THREADS_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CPU_AFFINITY,
+      g_param_spec_string ("cpu-affinity", "CPU affinity",
+        "CPUs the inference thread and its runtime thread pool run on, "
+        "as a list like \"2-3\" or \"1,3\", empty for all",
+        CPU_AFFINITY_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SCHED_POLICY,
+      g_param_spec_enum("sched-policy", "Scheduling policy",
+        "Scheduling policy of the inference thread and its runtime thread "
+        "pool, real-time policies need CAP_SYS_NICE",
+        sched_policy_get_type(),
+        SCHED_POLICY_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SCHED_PRIORITY,
+      g_param_spec_int("sched-priority", "Scheduling priority",
+        "Real-time priority for the fifo and rr scheduling policies",
+        1, 99, SCHED_PRIORITY_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_MODE,
+      g_param_spec_enum("overlay-mode", "Overlay mode",
+        "Draw results into the video \"frame\" by CPU, or into an overlay "
+        "\"plane\" composited by the 2D device",
+        overlay_mode_get_type(),
+        OVERLAY_MODE_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_INPUT_STATS,
+      g_param_spec_boxed ("input-stats", "Input stats",
+        "Number of input frames used directly, imported from virtual memory, "
+        "or copied into physical memory",
+        GST_TYPE_STRUCTURE,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QOS_SHEDDING,
+      g_param_spec_boolean("qos-shedding", "QoS load shedding",
+        "Skip inference, stats drawing, then frames while downstream reports "
+        "lateness",
+        QOS_SHEDDING_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QOS_LEVEL,
+      g_param_spec_enum("qos-level", "QoS level",
+        "Current load shedding level",
+        qos_level_get_type(),
+        GstNnInferenceDemo::qos_level_none,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_INFERENCE_MODE,
+      g_param_spec_enum("inference-mode", "Inference mode",
+        "Run inference on every frame (\"sync\"), or on the latest frame in "
+        "a worker thread, showing the last results meanwhile (\"latest\"), "
+        "or on every frame by model replicas in parallel, frames are held "
+        "until their results are drawn (\"offline\", for file processing), "
+        "or on the configured backend and on CPU (XNNPACK) at once, each "
+        "frame on the one expected to finish first (\"hetero\")",
+        inference_mode_get_type(),
+        INFERENCE_MODE_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_INFERENCE_INTERVAL,
+      g_param_spec_uint("inference-interval", "Inference interval",
+        "Run the model on one frame out of N, the frames in between are "
+        "drawn with the last results (extrapolated by the pose tracker)",
+        1, G_MAXUINT, INFERENCE_INTERVAL_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_REPLICAS,
+      g_param_spec_uint("replicas", "Replicas",
+        "Model instances run in parallel in offline inference mode, each "
+        "with its own interpreter, applied when offline mode starts",
+        1, 16, REPLICAS_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STARTUP,
+      g_param_spec_enum("startup", "Startup policy",
+        "The model is loaded in the background from READY to PAUSED, hold "
+        "the first frame until it is ready (\"wait\"), or forward frames "
+        "without results meanwhile (\"passthrough\")",
+        startup_get_type(),
+        STARTUP_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STARTUP_STATS,
+      g_param_spec_boxed ("startup-stats", "Startup stats",
+        "Time to the first frame out and to the first frame with results "
+        "(ns), since READY to PAUSED, 0 until then",
+        GST_TYPE_STRUCTURE,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_STATS,
+      g_param_spec_boxed ("latency-stats", "Latency stats",
+        "Smoothed processing, held and capture-to-output latency (ns), last "
+        "inference latency (ms) and discarded inference requests",
+        GST_TYPE_STRUCTURE,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
   g_object_class_install_property (gobject_class, PROP_MODEL,
       g_param_spec_string ("model", "NN Inference model", "Path of the NN Inference model file",
         MODEL_DEFAULT,
@@ -1746,11 +4108,62 @@ class_init (
         LABEL_DEFAULT,
         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+  g_object_class_install_property (gobject_class, PROP_SECONDARY_MODEL,
+      g_param_spec_string ("secondary-model", "Secondary NN Inference model",
+        "Path of the model run on each detection in cascade mode",
+        SECONDARY_MODEL_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CASCADE_LABEL,
+      g_param_spec_int("cascade-label", "Cascade label",
+        "Label id of the detections cropped for the secondary model",
+        0, G_MAXINT, CASCADE_LABEL_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CASCADE_MAX_CROPS,
+      g_param_spec_int("cascade-max-crops", "Cascade crop budget",
+        "Detections run through the secondary model per frame, largest first",
+        0, POSE_NUM_POSE_MAX, CASCADE_MAX_CROPS_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CLASSIFIER_TOP_K,
+      g_param_spec_int("classifier-top-k", "Classifier top-k",
+        "Best classes displayed in classifier mode",
+        1, classifier_t::TOP_K_MAX, CLASSIFIER_TOP_K_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CLASSIFIER_SMOOTHING,
+      g_param_spec_float("classifier-smoothing", "Classifier smoothing",
+        "Weight of the newest scores in the running average of classifier "
+        "mode, 1.0 disables the averaging",
+        0.01, 1.0, CLASSIFIER_SMOOTHING_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CPU_POOL_THREADS,
+      g_param_spec_int("cpu-pool-threads", "CPU pool threads",
+        "Worker threads of the CPU pool shared by the elements of the "
+        "process, for input copies, model input conversion and "
+        "post-processing, 0 to run them in the calling thread. Set once "
+        "per process, by the first element setting it",
+        0, 16, CPU_POOL_THREADS_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CPU_POOL_AFFINITY,
+      g_param_spec_string ("cpu-pool-affinity", "CPU pool affinity",
+        "CPUs the shared CPU pool threads run on, as a list like \"0-1\", "
+        "empty for all. Set once per process, by the first element setting it",
+        CPU_POOL_AFFINITY_DEFAULT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
 
   in_plugin->destroy(dev);
 
   base_transform_class->src_event =
       GST_DEBUG_FUNCPTR(src_event);
+  base_transform_class->sink_event =
+      GST_DEBUG_FUNCPTR(sink_event);
+  base_transform_class->query =
+      GST_DEBUG_FUNCPTR(transform_query);
   base_transform_class->transform_caps =
       GST_DEBUG_FUNCPTR(transform_caps);
   base_transform_class->fixate_caps =
@@ -1799,10 +4212,80 @@ init (
   demo->demo_mode = DEMO_MODE_DEFAULT;
   demo->model = NULL;
   demo->label = NULL;
+  demo->secondary_model = NULL;
+  demo->cascade_label = CASCADE_LABEL_DEFAULT;
+  demo->cascade_max_crops = CASCADE_MAX_CROPS_DEFAULT;
+  demo->classifier_top_k = CLASSIFIER_TOP_K_DEFAULT;
+  demo->classifier_smoothing = CLASSIFIER_SMOOTHING_DEFAULT;
   demo->display_stats = DISPLAY_STATS_DEFAULT;
   demo->use_nnapi = USE_NNAPI_DEFAULT;
   demo->enable_inference = ENABLE_INFERENCE_DEFAULT;
   demo->num_threads = NUM_THREADS_DEFAULT;
+  demo->cpu_affinity = NULL;
+  demo->cpu_affinity_set = FALSE;
+  demo->sched_policy = SCHED_POLICY_DEFAULT;
+  demo->sched_priority = SCHED_PRIORITY_DEFAULT;
+  demo->sched_policy_set = FALSE;
+  demo->autotune_threads = AUTOTUNE_THREADS_DEFAULT;
+  demo->overlay_mode = OVERLAY_MODE_DEFAULT;
+  demo->overlay = NULL;
+  demo->mask_layer = NULL;
+  demo->mask_disabled = FALSE;
+  demo->in_direct_count = 0;
+  demo->in_imported_count = 0;
+  demo->in_copied_count = 0;
+  demo->cpu_pool = new std::shared_ptr<worker_pool_t> ();
+  demo->cpu_pool_generation = 0;
+  demo->qos_shedding = QOS_SHEDDING_DEFAULT;
+  demo->qos_level = GstNnInferenceDemo::qos_level_none;
+  demo->qos_proportion = 1.0;
+  demo->qos_frame_count = 0;
+  demo->qos_dropped_count = 0;
+  demo->qos_run_inference = ENABLE_INFERENCE_DEFAULT;
+  demo->qos_draw_stats = DISPLAY_STATS_DEFAULT;
+  demo->inference_mode = INFERENCE_MODE_DEFAULT;
+  demo->inference_interval = INFERENCE_INTERVAL_DEFAULT;
+  demo->replicas = REPLICAS_DEFAULT;
+  demo->replica_pool = NULL;
+  demo->offline_frames = new std::deque<GstNnInferenceDemo::offline_frame_t> ();
+  demo->offline_next = 0;
+  demo->offline_frame.replica = -1;
+  demo->offline_frame.dst.mem = NULL;
+  demo->offline_last = -1;
+  demo->replica_config = NULL;
+  demo->replica_wanted = 0;
+  demo->replica_serial = 0;
+  demo->replica_policy_changed = FALSE;
+  demo->replica_inferences = new std::vector<inference_t *> ();
+  demo->replica_mode = INFERENCE_MODE_DEFAULT;
+  demo->infer_pad = NULL;
+  g_mutex_init (&demo->infer_lock);
+  demo->infer_info_valid = FALSE;
+  demo->infer_buffers = new std::deque<GstNnInferenceDemo::infer_buffer_t> ();
+  gst_segment_init (&demo->infer_segment, GST_FORMAT_TIME);
+  demo->infer_matched_count = 0;
+  demo->infer_missed_count = 0;
+  demo->startup = STARTUP_DEFAULT;
+  demo->startup_time = 0;
+  demo->first_frame_time = 0;
+  demo->first_result_time = 0;
+  demo->inference_worker = NULL;
+  demo->inference_discarded_count = 0;
+  demo->processing_latency = 0;
+  demo->hold_latency = 0;
+  demo->reported_latency = 0;
+  demo->capture_latency = 0;
+  demo->capture_latency_max = 0;
+  demo->inference = NULL;
+  demo->inference_demo_mode = DEMO_MODE_DEFAULT;
+  g_mutex_init (&demo->inference_lock);
+  g_cond_init (&demo->reload_cond);
+  demo->reload_thread = NULL;
+  demo->reload_running = FALSE;
+  demo->reload_failed = FALSE;
+  demo->reload_config = NULL;
+  demo->reload_inference = NULL;
+  demo->reload_demo_mode = DEMO_MODE_DEFAULT;
 }
 
 static gboolean
@@ -27,11 +27,22 @@ extern "C" {
 #include "imx_2d_device.h"
 }
 #include <chrono>
+#include <deque>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 #include "inference.h"
+#include "inference_worker.h"
+#include "replica_pool.h"
+#include "overlay.h"
+#include "mask_layer.h"
+#include "worker_pool.h"
 
 G_BEGIN_DECLS
 
+struct inference_config_t;
+
 /* nninferencedemo object and class definition */
 typedef struct _GstNnInferenceDemo {
   GstVideoFilter element;
@@ -46,27 +57,186 @@ typedef struct _GstNnInferenceDemo {
   GstVideoAlignment out_video_align;
   gboolean pool_config_update;
 
+  /* input frames used as is, imported by virtual address, or copied */
+  guint64 in_direct_count;
+  guint64 in_imported_count;
+  guint64 in_copied_count;
+
+  /* CPU pool shared by the elements of the process, split by rows for
+   * input copies and by the model heads, guarded by inference_lock. Taken
+   * again when the process-wide settings change */
+  std::shared_ptr<worker_pool_t> *cpu_pool;
+  guint cpu_pool_generation;
+
   /* properties */
   enum DemoMode {
     tflite_posenet,
     tflite_mobilenet_ssd,
     tflite_benchmark,
+    tflite_cascade,
+    tflite_classifier,
+    tflite_segmentation,
   } demo_mode;
   Imx2DRotationMode rotate;
   gchar *model;
   gchar *label;
+  /* cascade mode */
+  gchar *secondary_model;
+  gint cascade_label;
+  gint cascade_max_crops;
+  /* classifier mode */
+  gint classifier_top_k;
+  gfloat classifier_smoothing;
   gboolean display_stats;
   gint use_nnapi;
   gboolean enable_inference;
   gint num_threads;
+  /* inference thread and runtime thread pool placement, left alone until the
+   * properties are set */
+  gchar *cpu_affinity;
+  gboolean cpu_affinity_set;
+  enum SchedPolicy {
+    sched_other,
+    sched_fifo,
+    sched_rr,
+  } sched_policy;
+  gint sched_priority;
+  gboolean sched_policy_set;
+  gboolean autotune_threads;
+  enum OverlayMode {
+    overlay_frame,
+    overlay_plane,
+  } overlay_mode;
+
+  /* QoS driven load shedding. The level is raised and lowered from the
+   * smoothed proportion of the src pad QoS events, then each frame gets its
+   * inference/stats decision from it */
+  gboolean qos_shedding;
+  enum QosLevel {
+    qos_level_none,
+    qos_level_skip_inference,
+    qos_level_reduce_drawing,
+    qos_level_drop_frames,
+  } qos_level;
+  gdouble qos_proportion;
+  guint64 qos_frame_count;
+  guint64 qos_dropped_count;
+  gboolean qos_run_inference;
+  gboolean qos_draw_stats;
+
+  /* latest-frame mode runs the model on inference_worker, frames arriving
+   * while it is busy are shown with the last results */
+  enum InferenceMode {
+    inference_sync,
+    inference_latest,
+    inference_offline,
+    inference_hetero,
+  } inference_mode;
+  inference_worker_t *inference_worker;
+  guint64 inference_discarded_count;
+  /* run the model on one frame out of inference_interval */
+  guint inference_interval;
+
+  /* offline and hetero modes run frames on replicas of the model, output
+   * buffers are held, sorted by PTS, until their results are drawn */
+  guint replicas;
+  replica_pool_t *replica_pool;
+  enum InferenceMode replica_mode;
+  struct offline_frame_t {
+    GstBuffer *buffer;
+    GstVideoInfo info;
+    /* the output for the 2D device, dst.mem is NULL when the device can't
+     * reach it, otherwise a copy of it is kept in dst_mem */
+    Imx2DFrame dst;
+    PhyMemBlock dst_mem;
+    /* replica holding its results, -1 for none */
+    gint replica;
+    gboolean drawn;
+    /* monotonic time it was queued, in us */
+    gint64 queue_time;
+  };
+  std::deque<offline_frame_t> *offline_frames;
+  guint offline_next;
+  /* the frame in process, for the transform wrapper, and the replica of
+   * the last frame submitted */
+  offline_frame_t offline_frame;
+  gint offline_last;
+  /* replicas built by reload_thread, guarded by inference_lock. Builds
+   * started before the last replica_serial change are dropped */
+  inference_config_t *replica_config;
+  guint replica_wanted;
+  guint replica_serial;
+  std::vector<inference_t *> *replica_inferences;
+  /* placement properties changed since the pool replicas were updated */
+  gboolean replica_policy_changed;
 
-  /* inference object */
+  /* the model is loaded from READY to PAUSED, frames arriving before it is
+   * ready wait for it, or go through without results */
+  enum StartupPolicy {
+    startup_wait,
+    startup_passthrough,
+  } startup;
+  /* time to first frame out and to first frame with results, from the
+   * READY to PAUSED change, in ns, 0 until then */
+  gint64 startup_time;
+  GstClockTime first_frame_time;
+  GstClockTime first_result_time;
+
+  /* latency, processing and held are smoothed, capture-to-output is from
+   * buffer running time to the time the frame leaves the element */
+  GstClockTime processing_latency;
+  GstClockTime hold_latency;
+  GstClockTime reported_latency;
+  GstClockTime capture_latency;
+  GstClockTime capture_latency_max;
+
+  /* inference object, replaced by the streaming thread only, other
+   * threads hold inference_lock to use it */
   inference_t *inference;
+  enum DemoMode inference_demo_mode;
+  GMutex inference_lock;
+
+  /* hot model swap, guarded by inference_lock */
+  std::thread *reload_thread;
+  GCond reload_cond;
+  gboolean reload_running;
+  /* the first build failed, nothing to run */
+  gboolean reload_failed;
+  inference_config_t *reload_config;
+  inference_t *reload_inference;
+  enum DemoMode reload_demo_mode;
+
+  /* infer_sink request pad: a model sized stream of the same sensor, the
+   * buffer closest in running time to the display frame is loaded as model
+   * input instead of resizing the display frame. Queue guarded by
+   * infer_lock */
+  GstPad *infer_pad;
+  GMutex infer_lock;
+  GstVideoInfo infer_info;
+  gboolean infer_info_valid;
+  GstSegment infer_segment;
+  struct infer_buffer_t {
+    GstBuffer *buffer;
+    /* in the infer_sink segment the buffer came with */
+    GstClockTime running_time;
+  };
+  std::deque<infer_buffer_t> *infer_buffers;
+  guint64 infer_matched_count;
+  guint64 infer_missed_count;
+
+  /* overlay plane, used by overlay_plane mode */
+  overlay_t *overlay;
+  /* low resolution mask blended by 2D, for heads with per pixel results */
+  mask_layer_t *mask_layer;
+  gboolean mask_disabled;
 } GstNnInferenceDemo;
 
 typedef struct _GstNnInferenceDemoClass {
   GstVideoFilterClass parent_class;
   const Imx2DDeviceInfo *in_plugin;
+
+  /* actions */
+  void (*reload) (struct _GstNnInferenceDemo *demo);
 } GstNnInferenceDemoClass;
 
 G_END_DECLS
@@ -127,6 +127,11 @@ struct _Imx2DDevice {
   gint (*config_input)    (Imx2DDevice* device, Imx2DVideoInfo* in_info);
   gint (*config_output)   (Imx2DDevice* device, Imx2DVideoInfo* out_info);
   gint (*convert)   (Imx2DDevice* device, Imx2DFrame *dst, Imx2DFrame *src);
+  /* submit a convert without waiting for it, the current config is captured
+   * at submission. wait() blocks until all the jobs submitted by the calling
+   * thread are done. Optional, may be NULL */
+  gint (*convert_async) (Imx2DDevice* device, Imx2DFrame *dst, Imx2DFrame *src);
+  gint (*wait)          (Imx2DDevice* device);
   gint (*blend)        (Imx2DDevice* device, Imx2DFrame *dst, Imx2DFrame *src);
   gint (*blend_finish) (Imx2DDevice* device);
   gint (*fill)         (Imx2DDevice* device, Imx2DFrame *dst, guint RGBA8888);
@@ -150,4 +155,9 @@ const Imx2DDeviceInfo * imx_get_2d_devices(void);
 Imx2DDevice * imx_2d_device_create(Imx2DDeviceType  device_type);
 gint imx_2d_device_destroy(Imx2DDevice *device);
 
+#ifdef USE_G2D
+/* g2d handle of the calling thread, closed when the thread exits */
+void * imx_g2d_get_thread_handle(void);
+#endif
+
 #endif /* __IMX_2D_DEVICE_H__ */
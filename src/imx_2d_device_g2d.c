@@ -19,6 +19,7 @@
  */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include "g2d.h"
 #include "g2dExt.h"
@@ -107,6 +108,40 @@ static G2dFmtMap g2d_fmts_map_dpu[] = {
     {GST_VIDEO_FORMAT_UNKNOWN, -1,          0}
 };
 
+/* GPU 2D based g2d needs all function calls in the same thread, so each
+ * thread gets its own handle, opened on first use and closed at thread exit */
+static pthread_key_t g2d_handle_key;
+static pthread_once_t g2d_handle_key_once = PTHREAD_ONCE_INIT;
+
+static void imx_g2d_thread_handle_free(void *g2d_handle)
+{
+  GST_DEBUG ("close g2d handle %p", g2d_handle);
+  g2d_close(g2d_handle);
+}
+
+static void imx_g2d_thread_handle_key_init(void)
+{
+  pthread_key_create(&g2d_handle_key, imx_g2d_thread_handle_free);
+}
+
+void * imx_g2d_get_thread_handle(void)
+{
+  void *g2d_handle;
+
+  pthread_once(&g2d_handle_key_once, imx_g2d_thread_handle_key_init);
+  g2d_handle = pthread_getspecific(g2d_handle_key);
+  if (!g2d_handle) {
+    if (g2d_open(&g2d_handle) == -1 || g2d_handle == NULL) {
+      GST_ERROR ("%s Failed to open g2d device.",__FUNCTION__);
+      return NULL;
+    }
+    pthread_setspecific(g2d_handle_key, g2d_handle);
+    GST_DEBUG ("opened g2d handle %p", g2d_handle);
+  }
+
+  return g2d_handle;
+}
+
 static const G2dFmtMap * imx_g2d_get_format(GstVideoFormat format)
 {
   const G2dFmtMap *map;
@@ -237,9 +272,9 @@ static gint imx_g2d_copy_mem(Imx2DDevice* device, PhyMemBlock *dst_mem,
   if (HAS_DPU()) {
     g2d_handle = g2d->g2d_handle;
   } else {
-    if(g2d_open(&g2d_handle) == -1 || g2d_handle == NULL) {
+    g2d_handle = imx_g2d_get_thread_handle();
+    if (!g2d_handle) {
       g2d_free (pbuf);
-      GST_ERROR ("%s Failed to open g2d device.",__FUNCTION__);
       return -1;
     }
   }
@@ -258,9 +293,6 @@ static gint imx_g2d_copy_mem(Imx2DDevice* device, PhyMemBlock *dst_mem,
 
   g2d_copy (g2d_handle, &dst, &src, size);
   g2d_finish(g2d_handle);
-  if (!HAS_DPU()) {
-    g2d_close (g2d_handle);
-  }
 
   GST_DEBUG ("G2D copy from vaddr (%p), paddr (%p), size (%ld) to "
       "vaddr (%p), paddr (%p), size (%ld)",
@@ -284,10 +316,9 @@ static gint imx_g2d_frame_copy(Imx2DDevice *device,
   if (HAS_DPU()) {
     g2d_handle = g2d->g2d_handle;
   } else {
-    if(g2d_open(&g2d_handle) == -1 || g2d_handle == NULL) {
-      GST_ERROR ("%s Failed to open g2d device.",__FUNCTION__);
+    g2d_handle = imx_g2d_get_thread_handle();
+    if (!g2d_handle)
       return -1;
-    }
   }
 
   src.buf_handle = NULL;
@@ -302,9 +333,6 @@ static gint imx_g2d_frame_copy(Imx2DDevice *device,
   ret = g2d_copy (g2d_handle, &dst, &src, dst.buf_size);
 
   g2d_finish(g2d_handle);
-  if (!HAS_DPU()) {
-    g2d_close (g2d_handle);
-  }
   GST_LOG("G2D frame memory (%p)->(%p)", from->paddr, to->paddr);
 
   return ret;
@@ -374,8 +402,8 @@ static gint imx_g2d_set_src_plane(struct g2d_surface *g2d_src, gchar *paddr)
     case G2D_I420:
     case G2D_YV12:
       g2d_src->planes[0] = (gint)(long)(paddr);
-      g2d_src->planes[1] = (gint)(long)(paddr + g2d_src->width * g2d_src->height);
-      g2d_src->planes[2] = g2d_src->planes[1]+g2d_src->width*g2d_src->height/4;
+      g2d_src->planes[1] = (gint)(long)(paddr + g2d_src->stride * g2d_src->height);
+      g2d_src->planes[2] = g2d_src->planes[1]+g2d_src->stride*g2d_src->height/4;
       break;
     case G2D_NV12:
     case G2D_NV21:
@@ -417,7 +445,8 @@ static gboolean is_format_has_alpha(enum g2d_format fmt) {
 }
 
 static gint imx_g2d_blit(Imx2DDevice *device,
-                            Imx2DFrame *dst, Imx2DFrame *src, gboolean alpha_en)
+                            Imx2DFrame *dst, Imx2DFrame *src, gboolean alpha_en,
+                            gboolean finish)
 {
   gint ret = 0;
   void *g2d_handle = NULL;
@@ -429,12 +458,10 @@ static gint imx_g2d_blit(Imx2DDevice *device,
   if (HAS_DPU()) {
     g2d_handle = g2d->g2d_handle;
   } else {
-    /* g2d_open () every frame as GPU 2D based g2d need all function call in
-     * same thread */
-    if(g2d_open(&g2d_handle) == -1 || g2d_handle == NULL) {
-      GST_ERROR ("%s Failed to open g2d device.",__FUNCTION__);
+    /* GPU 2D based g2d need all function call in same thread */
+    g2d_handle = imx_g2d_get_thread_handle();
+    if (!g2d_handle)
       return -1;
-    }
   }
 
   GST_DEBUG ("src paddr fd vaddr: %p %d %p dst paddr fd vaddr: %p %d %p",
@@ -444,7 +471,7 @@ static gint imx_g2d_blit(Imx2DDevice *device,
   unsigned long paddr = 0;
   if (!src->mem->paddr) {
     if (src->fd[0] >= 0) {
-      paddr = phy_addr_from_fd (src->fd[0]);
+      paddr = phy_addr_from_fd_cached (src->fd[0]);
     } else if (src->mem->vaddr) {
       paddr = phy_addr_from_vaddr (src->mem->vaddr, PAGE_ALIGN(src->mem->size));
     } else {
@@ -461,7 +488,7 @@ static gint imx_g2d_blit(Imx2DDevice *device,
     }
   }
   if (!dst->mem->paddr) {
-    paddr = phy_addr_from_fd (dst->fd[0]);
+    paddr = phy_addr_from_fd_cached (dst->fd[0]);
     if (paddr) {
       dst->mem->paddr = (guint8*)paddr;
     } else {
@@ -503,7 +530,7 @@ static gint imx_g2d_blit(Imx2DDevice *device,
   if (src->fd[1] >= 0)
   {
     if (!src->mem->user_data) {
-      g2d->src.base.planes[1] = (int)phy_addr_from_fd (src->fd[1]);
+      g2d->src.base.planes[1] = (int)phy_addr_from_fd_cached (src->fd[1]);
       src->mem->user_data = (void**)(long)g2d->src.base.planes[1];
     }
     else
@@ -525,8 +552,13 @@ static gint imx_g2d_blit(Imx2DDevice *device,
   // Set output
   g2d->dst.base.global_alpha = dst->alpha;
   g2d->dst.base.planes[0] = (gint)(long)(dst->mem->paddr);
+  /* chroma planes follow the padded luma plane */
   if (g2d->dst.base.format == G2D_NV12)
-    g2d->dst.base.planes[1] = (gint)(long)(dst->mem->paddr + g2d->dst.base.width * g2d->dst.base.height);
+    g2d->dst.base.planes[1] = (gint)(long)(dst->mem->paddr + g2d->dst.base.stride * g2d->dst.base.height);
+  else if (g2d->dst.base.format == G2D_I420) {
+    g2d->dst.base.planes[1] = (gint)(long)(dst->mem->paddr + g2d->dst.base.stride * g2d->dst.base.height);
+    g2d->dst.base.planes[2] = g2d->dst.base.planes[1] + g2d->dst.base.stride * g2d->dst.base.height / 4;
+  }
   g2d->dst.base.left = dst->crop.x;
   g2d->dst.base.top = dst->crop.y;
   g2d->dst.base.right = dst->crop.x + dst->crop.w;
@@ -584,20 +616,61 @@ static gint imx_g2d_blit(Imx2DDevice *device,
     ret = g2d_blitEx(g2d_handle, &g2d->src, &g2d->dst);
   }
 
-  ret |= g2d_finish(g2d_handle);
+  if (finish)
+    ret |= g2d_finish(g2d_handle);
 
 err:
-  if (!HAS_DPU()) {
-    g2d_close (g2d_handle);
-  }
-
   return ret;
 }
 
 static gint imx_g2d_convert(Imx2DDevice *device,
                             Imx2DFrame *dst, Imx2DFrame *src)
 {
-  return imx_g2d_blit(device, dst, src, FALSE);
+  return imx_g2d_blit(device, dst, src, FALSE, TRUE);
+}
+
+static gint imx_g2d_convert_async(Imx2DDevice *device,
+                                  Imx2DFrame *dst, Imx2DFrame *src)
+{
+  void *g2d_handle = NULL;
+  gint ret;
+
+  if (!device || !device->priv)
+    return -1;
+
+  Imx2DDeviceG2d *g2d = (Imx2DDeviceG2d *) (device->priv);
+  if (HAS_DPU()) {
+    g2d_handle = g2d->g2d_handle;
+  } else {
+    g2d_handle = imx_g2d_get_thread_handle();
+    if (!g2d_handle)
+      return -1;
+  }
+
+  /* surfaces are copied at submission, config can change right after */
+  ret = imx_g2d_blit(device, dst, src, FALSE, FALSE);
+  if (ret == 0)
+    ret = g2d_flush(g2d_handle);
+  return ret;
+}
+
+static gint imx_g2d_wait(Imx2DDevice *device)
+{
+  void *g2d_handle = NULL;
+
+  if (!device || !device->priv)
+    return -1;
+
+  Imx2DDeviceG2d *g2d = (Imx2DDeviceG2d *) (device->priv);
+  if (HAS_DPU()) {
+    g2d_handle = g2d->g2d_handle;
+  } else {
+    g2d_handle = imx_g2d_get_thread_handle();
+    if (!g2d_handle)
+      return -1;
+  }
+
+  return g2d_finish(g2d_handle);
 }
 
 static gint imx_g2d_set_rotate(Imx2DDevice *device, Imx2DRotationMode rot)
@@ -699,7 +772,7 @@ static GList* imx_g2d_get_supported_out_fmts(Imx2DDevice* device)
 
 static gint imx_g2d_blend(Imx2DDevice *device, Imx2DFrame *dst, Imx2DFrame *src)
 {
-  return imx_g2d_blit(device, dst, src, TRUE);
+  return imx_g2d_blit(device, dst, src, TRUE, TRUE);
 }
 
 static gint imx_g2d_blend_finish(Imx2DDevice *device)
@@ -721,18 +794,16 @@ static gint imx_g2d_fill_color(Imx2DDevice *device, Imx2DFrame *dst,
   if (HAS_DPU()) {
     g2d_handle = g2d->g2d_handle;
   } else {
-    /* g2d_open () every frame as GPU 2D based g2d need all function call in
-     * same thread */
-    if(g2d_open(&g2d_handle) == -1 || g2d_handle == NULL) {
-      GST_ERROR ("%s Failed to open g2d device.",__FUNCTION__);
+    /* GPU 2D based g2d need all function call in same thread */
+    g2d_handle = imx_g2d_get_thread_handle();
+    if (!g2d_handle)
       return -1;
-    }
   }
 
   GST_DEBUG ("dst paddr: %p fd: %d", dst->mem->paddr, dst->fd[0]);
   unsigned long paddr = 0;
   if (!dst->mem->paddr) {
-    paddr = phy_addr_from_fd (dst->fd[0]);
+    paddr = phy_addr_from_fd_cached (dst->fd[0]);
     if (paddr) {
       dst->mem->paddr = (guint8*)paddr;
     } else {
@@ -755,9 +826,6 @@ static gint imx_g2d_fill_color(Imx2DDevice *device, Imx2DFrame *dst,
 
   ret = g2d_clear(g2d_handle, &g2d->dst.base);
   ret |= g2d_finish(g2d_handle);
-  if (!HAS_DPU()) {
-    g2d_close (g2d_handle);
-  }
 
   return ret;
 }
@@ -782,6 +850,8 @@ Imx2DDevice * imx_g2d_create(Imx2DDeviceType  device_type)
   device->config_input        = imx_g2d_config_input;
   device->config_output       = imx_g2d_config_output;
   device->convert             = imx_g2d_convert;
+  device->convert_async       = imx_g2d_convert_async;
+  device->wait                = imx_g2d_wait;
   device->blend               = imx_g2d_blend;
   device->blend_finish        = imx_g2d_blend_finish;
   device->fill                = imx_g2d_fill_color;
@@ -24,6 +24,7 @@
 
 #include "inference.h"
 #include "utils.h"
+#include <string.h>
 extern "C" {
 #include <gst/allocators/gstallocatorphymem.h>
 }
@@ -34,12 +35,20 @@ extern "C" {
 GST_DEBUG_CATEGORY(inference_t_debug);
 #define GST_CAT_DEFAULT inference_t_debug
 
+#define STATS_FONT_FACE (cv::FONT_HERSHEY_SIMPLEX)
+#define STATS_FONT_SCALE (0.7)
+#define STATS_THICKNESS (2)
+// stats text is refreshed at this interval, and drawn from cache in between
+#define STATS_UPDATE_INTERVAL (0.5)
+// model input rows converted per worker pool slice, at least
+#define INPUT_ROWS_GRAIN (16)
+
 inference_t::inference_t() :
-  bgrx_buf_(NULL),
-  g2d_handle_(NULL)
+  bgrx_buf_(NULL)
 {
   GST_DEBUG_CATEGORY_INIT(inference_t_debug, "inference_t", 0, "i.MX NN Inference demo inference class");
   GST_TRACE("%s", __func__);
+  text_renderer_.init(STATS_FONT_FACE, STATS_FONT_SCALE, STATS_THICKNESS);
 }
 
 inference_t::~inference_t()
@@ -58,17 +67,6 @@ int inference_t::setup_g2d(void)
 {
   GST_TRACE("%s", __func__);
 
-  int ret = 0;
-  if (!g2d_handle_) {
-    ret = g2d_open(&g2d_handle_);
-    if (ret != 0 || g2d_handle_ == NULL)
-    {
-      GST_ERROR ("g2d_open failed");
-      return ERROR;
-    }
-    GST_TRACE("g2d_handle: %p", g2d_handle_);
-  }
-
   // alloc BGRx buffer
   std::vector<int> shape;
   get_input_tensor_shape(&shape);
@@ -77,7 +75,14 @@ int inference_t::setup_g2d(void)
   bgrx_channels_ = shape[3];
   GST_TRACE("wanted size: %dx%dx%d", bgrx_width_, bgrx_height_, bgrx_channels_);
   bgrx_stride_ = (bgrx_width_ + 15) & (~0xf);
-  bgrx_size_ = PAGE_ALIGN(bgrx_stride_ * bgrx_height_ * 4);
+  size_t size = PAGE_ALIGN(bgrx_stride_ * bgrx_height_ * 4);
+
+  // kept across frames, only reallocated if the input tensor changes
+  if (bgrx_buf_ && (size != bgrx_size_)) {
+    g2d_free(bgrx_buf_);
+    bgrx_buf_ = NULL;
+  }
+  bgrx_size_ = size;
 
   if (!bgrx_buf_) {
     bgrx_buf_ = g2d_alloc(bgrx_size_, 1);
@@ -99,10 +104,6 @@ int inference_t::clean_g2d(void)
     g2d_free(bgrx_buf_);
     bgrx_buf_ = NULL;
   }
-  if (g2d_handle_) {
-    g2d_close(g2d_handle_);
-    g2d_handle_ = NULL;
-  }
   return OK;
 }
 
@@ -156,42 +157,199 @@ int inference_t::setup_input_tensor(
   }
 
   // blit by g2d api
-  ret = g2d_blit(g2d_handle_, &src, &dst);
+  void *g2d_handle = imx_g2d_get_thread_handle();
+  if (!g2d_handle) {
+    GST_ERROR ("g2d_open failed");
+    return ERROR;
+  }
+  ret = g2d_blit(g2d_handle, &src, &dst);
+  if (ret != 0) {
+    GST_ERROR ("g2d_blit failed (ret=%d)", ret);
+    return ERROR;
+  }
+  g2d_finish(g2d_handle);
+
+  return load_input_tensor();
+}
+
+int inference_t::setup_input_frame(
+  int video_width,
+  int video_height,
+  Imx2DRotationMode rotate,
+  Imx2DFrame *frame)
+{
+  GST_TRACE("%s", __func__);
+
+  video_width_ = video_width;
+  video_height_ = video_height;
+
+  int ret = setup_g2d();
+  if (ret != OK) {
+    GST_ERROR("setup_g2d failed");
+    return ret;
+  }
+
+  bgrx_mem_.vaddr = (guint8 *)bgrx_buf_->buf_vaddr;
+  bgrx_mem_.paddr = (guint8 *)(long)bgrx_buf_->buf_paddr;
+  bgrx_mem_.size = bgrx_size_;
+
+  memset(frame, 0, sizeof(*frame));
+  frame->mem = &bgrx_mem_;
+  frame->fd[0] = frame->fd[1] = frame->fd[2] = frame->fd[3] = -1;
+  frame->info.fmt = GST_VIDEO_FORMAT_BGRx;
+  frame->info.w = bgrx_width_;
+  frame->info.h = bgrx_height_;
+  frame->info.stride = bgrx_stride_ * 4;
+  frame->crop.w = bgrx_width_;
+  frame->crop.h = bgrx_height_;
+  frame->rotate = rotate;
+  frame->interlace_type = IMX_2D_INTERLACE_PROGRESSIVE;
+  frame->alpha = 0xFF;
+  return OK;
+}
+
+int inference_t::load_input_tensor(void)
+{
+  return load_input_tensor((const uint8_t *)bgrx_buf_->buf_vaddr);
+}
+
+int inference_t::blit_input_crop(
+  GstVideoInfo *vinfo,
+  Imx2DFrame *src_frame,
+  const cv::Rect& crop,
+  g2d_buf *dst_buf)
+{
+  GST_TRACE("%s", __func__);
+
+  struct g2d_surface src;
+  int ret = setup_g2d_surface(
+    vinfo->finfo->format,
+    vinfo->width,
+    vinfo->height,
+    src_frame->mem->paddr,
+    IMX_2D_ROTATION_0,
+    &src);
+  if (ret != OK) {
+    GST_ERROR("setup_surface failed");
+    return ret;
+  }
+  src.left = crop.x;
+  src.top = crop.y;
+  src.right = crop.x + crop.width;
+  src.bottom = crop.y + crop.height;
+
+  struct g2d_surface dst;
+  ret = setup_g2d_surface(
+    GST_VIDEO_FORMAT_BGRx,
+    bgrx_width_,
+    bgrx_height_,
+    (uint8_t*)(long)(dst_buf->buf_paddr),
+    IMX_2D_ROTATION_0,
+    &dst);
+  if (ret != OK) {
+    GST_ERROR("setup_surface failed");
+    return ret;
+  }
+
+  void *g2d_handle = imx_g2d_get_thread_handle();
+  if (!g2d_handle) {
+    GST_ERROR ("g2d_open failed");
+    return ERROR;
+  }
+  ret = g2d_blit(g2d_handle, &src, &dst);
   if (ret != 0) {
     GST_ERROR ("g2d_blit failed (ret=%d)", ret);
     return ERROR;
   }
-  g2d_finish(g2d_handle_);
+  return OK;
+}
+
+void inference_t::bgrx_to_rgb(
+  const uint8_t *bgrx,
+  uint8_t *rgb,
+  int stride)
+{
+  parallel_for(bgrx_height_, INPUT_ROWS_GRAIN, [&](int first, int last) {
+    utils::bgrx_to_rgb((uint8_t *)bgrx + first * stride,
+        rgb + first * bgrx_width_ * 3, bgrx_width_, last - first, stride / 4);
+  });
+}
+
+int inference_t::load_input_tensor(const uint8_t *src)
+{
+  GST_TRACE("%s", __func__);
+
+  int ret = OK;
 
   // convert BGRx8888 to RGB888
-  uint8_t *bgrx = (uint8_t *)bgrx_buf_->buf_vaddr;
+  uint8_t *bgrx = (uint8_t *)src;
   size_t sz = 0;
   uint8_t *rgb = 0;
   ret = get_input_tensor(&rgb, &sz);
   if (ret == OK) {
     GST_TRACE("bgrx, rgb, sz, expected sz = {%p, %p, %ld, %d}", bgrx, rgb, sz, (bgrx_width_ * bgrx_height_ * bgrx_channels_));
-    uint8_t *p = bgrx;
-    uint8_t *q = rgb;
-    utils::bgrx_to_rgb(p, q, bgrx_width_, bgrx_height_, bgrx_stride_);
+    bgrx_to_rgb(bgrx, rgb, bgrx_stride_ * 4);
   } else {
     sz = bgrx_width_ * bgrx_height_ * bgrx_channels_;
     rgb = new uint8_t [sz];
     GST_TRACE("bgrx, rgb, sz, expected sz = {%p, %p, %ld, %d}", bgrx, rgb, sz, (bgrx_width_ * bgrx_height_ * bgrx_channels_));
-    uint8_t *p = bgrx;
-    uint8_t *q = rgb;
-    utils::bgrx_to_rgb(p, q, bgrx_width_, bgrx_height_, bgrx_stride_);
-    ret = copy_data_to_input_tensor(q, sz);
+    bgrx_to_rgb(bgrx, rgb, bgrx_stride_ * 4);
+    ret = copy_data_to_input_tensor(rgb, sz);
     assert(ret == 0);
     delete [] rgb;
   }
 
-  // clean up g2d
-  ret = clean_g2d();
-  if (ret != OK) {
-    GST_ERROR("clean_g2d failed");
+  return OK;
+}
+
+int inference_t::load_input_frame(
+  const uint8_t *data,
+  GstVideoFormat format,
+  int width,
+  int height,
+  int stride)
+{
+  GST_TRACE("%s", __func__);
+
+  std::vector<int> shape;
+  get_input_tensor_shape(&shape);
+  if ((shape.size() != 4) || (width != shape[2]) || (height != shape[1]) || (shape[3] != 3)) {
+    GST_DEBUG("%dx%d frame for a %dx%d input", width, height,
+        (shape.size() == 4) ? shape[2] : 0, (shape.size() == 4) ? shape[1] : 0);
     return ERROR;
   }
-  return OK;
+  bgrx_height_ = shape[1];
+  bgrx_width_ = shape[2];
+  bgrx_channels_ = shape[3];
+
+  size_t sz = 0;
+  uint8_t *rgb = 0;
+  uint8_t *tmp = 0;
+  if (get_input_tensor(&rgb, &sz) != OK) {
+    sz = width * height * 3;
+    rgb = tmp = new uint8_t [sz];
+  }
+
+  if ((format == GST_VIDEO_FORMAT_BGRx) || (format == GST_VIDEO_FORMAT_BGRA)) {
+    bgrx_to_rgb(data, rgb, stride);
+  } else if (format == GST_VIDEO_FORMAT_RGB) {
+    parallel_for(height, INPUT_ROWS_GRAIN, [&](int first, int last) {
+      for (int y = first; y < last; y++) {
+        memcpy(rgb + y * width * 3, data + y * stride, width * 3);
+      }
+    });
+  } else {
+    GST_DEBUG("unsupported format %s", gst_video_format_to_string(format));
+    delete [] tmp;
+    return ERROR;
+  }
+
+  int ret = OK;
+  if (tmp) {
+    ret = copy_data_to_input_tensor(tmp, sz);
+    delete [] tmp;
+  }
+  return ret;
 }
 
 int
@@ -301,21 +459,68 @@ inference_t::setup_g2d_surface(
   return OK;
 }
 
-int inference_t::calc_stats(cv::Mat& frame)
+void inference_t::set_thread_policy(const thread_policy_t& policy)
 {
   GST_TRACE("%s", __func__);
 
+  std::lock_guard<std::mutex> lock(thread_policy_mutex_);
+  thread_policy_ = policy;
+  thread_policy_changed_ = true;
+}
+
+bool inference_t::get_thread_policy(thread_policy_t *policy)
+{
+  std::lock_guard<std::mutex> lock(thread_policy_mutex_);
+  if (!thread_policy_changed_) {
+    return false;
+  }
+  *policy = thread_policy_;
+  thread_policy_changed_ = false;
+  return true;
+}
+
+void inference_t::set_worker_pool(const std::shared_ptr<worker_pool_t>& pool)
+{
+  std::lock_guard<std::mutex> lock(worker_pool_mutex_);
+  worker_pool_ = pool;
+}
+
+void inference_t::parallel_for(
+  int n,
+  int grain,
+  const std::function<void(int, int)>& body)
+{
+  std::shared_ptr<worker_pool_t> pool;
+  {
+    std::lock_guard<std::mutex> lock(worker_pool_mutex_);
+    pool = worker_pool_;
+  }
+  if (pool) {
+    pool->parallel_for(n, grain, body);
+  } else if (n > 0) {
+    body(0, n);
+  }
+}
+
+int inference_t::calc_stats(canvas_t& canvas)
+{
+  GST_TRACE("%s", __func__);
+
+  std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
   if (stats_initialized_) {
     frame_count_++;
-    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
     std::chrono::duration<double> uptime = time - start_time_;
     uptime_ = uptime.count();
     fps_ = (double)frame_count_ / uptime_;
     inference_time_total_ += inference_time_cur_;
     inference_time_avg_ = inference_time_total_ / frame_count_;
+    std::chrono::duration<double> elapsed = time - stats_update_time_;
+    if (elapsed.count() < STATS_UPDATE_INTERVAL) {
+      return OK;
+    }
   } else {
     // initialize
-    start_time_ = std::chrono::steady_clock::now();
+    start_time_ = time;
     frame_count_ = 0;
     uptime_ = 0.0;
     fps_ = 0;
@@ -323,6 +528,7 @@ int inference_t::calc_stats(cv::Mat& frame)
     inference_time_total_ = 0;
     inference_time_avg_ = 0;
   }
+  stats_update_time_ = time;
 
   char buf[256];
   // inference time stats
@@ -330,7 +536,7 @@ int inference_t::calc_stats(cv::Mat& frame)
     buf, sizeof(buf),
     "Inference time Avg: %6.3fms, Cur: %6.3fms (%.1ffps)",
     inference_time_avg_,
-    inference_time_cur_,
+    inference_time_cur_.load(),
     1000.0f / inference_time_avg_);
   inference_stats_ = buf;
   // fps stats
@@ -338,7 +544,7 @@ int inference_t::calc_stats(cv::Mat& frame)
     buf, sizeof(buf),
     "Video: %6.3ffps (Res: %dx%d, Frame: %ld, Uptime: %.3fs)",
     fps_,
-    frame.cols, frame.rows,
+    canvas.width(), canvas.height(),
     frame_count_,
     uptime_);
   fps_stats_ = buf;
@@ -347,7 +553,7 @@ int inference_t::calc_stats(cv::Mat& frame)
   return OK;
 }
 
-int inference_t::draw_stats(cv::Mat& frame)
+int inference_t::draw_stats(canvas_t& canvas)
 {
   GST_TRACE("%s", __func__);
 
@@ -355,91 +561,40 @@ int inference_t::draw_stats(cv::Mat& frame)
   int margin_left = 10;
   int margin_bottom = 10;
 
-  float font_scale = 0.7;
-  int thickness = 2;
-
-  int baseline = 0;
-  cv::Size text_sz_fps = cv::getTextSize(fps_stats_.c_str(), cv::FONT_HERSHEY_SIMPLEX, font_scale, thickness, &baseline);
-  GST_TRACE("fps-box w,h,b: %d, %d, %d", text_sz_fps.width, text_sz_fps.height, baseline);
-
-  cv::Size text_sz_inf = cv::getTextSize(inference_stats_.c_str(), cv::FONT_HERSHEY_SIMPLEX, font_scale, thickness, &baseline);
-  GST_TRACE("inf-box w,h,b: %d, %d, %d", text_sz_inf.width, text_sz_inf.height, baseline);
+  // glyphs are only re-blended into cached masks when the text has changed
+  text_renderer_.update(fps_text_, fps_stats_);
+  GST_TRACE("fps-box w,h,b: %d, %d, %d", fps_text_.size_.width, fps_text_.size_.height, fps_text_.baseline_);
+  text_renderer_.update(inference_text_, inference_stats_);
+  GST_TRACE("inf-box w,h,b: %d, %d, %d", inference_text_.size_.width, inference_text_.size_.height, inference_text_.baseline_);
 
+  int baseline = fps_text_.baseline_;
   cv::Size text_sz;
-  if (text_sz_fps.width > text_sz_inf.width) {
-    text_sz = text_sz_fps;
+  if (fps_text_.size_.width > inference_text_.size_.width) {
+    text_sz = fps_text_.size_;
   } else {
-    text_sz = text_sz_inf;
+    text_sz = inference_text_.size_;
   }
 
   // Draw white box to put label text in
-
-// this is for performance
-#define DRAW_WHITE_RECT
-
-// this is for performance
-#define LINE_TYPE (8)
-//#define LINE_TYPE (CV_FILLED)
-//#define LINE_TYPE (CV_AA)
-
   cv::Scalar color_white(255, 255, 255);
   cv::Scalar color_black(150, 150, 150);
-#if defined(DRAW_WHITE_RECT)
-  cv::rectangle(
-    frame,
-    cv::Point(margin_left - 4, frame.rows - margin_bottom - ((baseline * 2) + (text_sz.height * 2)) - 4),
-    cv::Point(margin_left + text_sz.width + 4, frame.rows - margin_bottom + 4),
+  canvas.rectangle(
+    cv::Point(margin_left - 4, canvas.height() - margin_bottom - ((baseline * 2) + (text_sz.height * 2)) - 4),
+    cv::Point(margin_left + text_sz.width + 4, canvas.height() - margin_bottom + 4),
     color_white,
     cv::FILLED);
-#endif
-  cv::putText(
-    frame,
+  text_renderer_.draw(
+    canvas,
+    inference_text_,
     inference_stats_,
-    cv::Point(margin_left, frame.rows - margin_bottom - (baseline * 2 + text_sz.height)),
-    cv::FONT_HERSHEY_SIMPLEX,
-    font_scale,
-    color_black,
-#if defined(DRAW_WHITE_RECT)
-    thickness,
-#else
-    thickness + 1,
-#endif
-    LINE_TYPE);
-#if !defined(DRAW_WHITE_RECT)
-  cv::putText(
-    frame,
-    inference_stats_,
-    cv::Point(margin_left, frame.rows - margin_bottom - (baseline * 2 + text_sz.height)),
-    cv::FONT_HERSHEY_SIMPLEX,
-    font_scale,
-    color_white,
-    thickness,
-    LINE_TYPE);
-#endif
-  cv::putText(
-    frame,
+    cv::Point(margin_left, canvas.height() - margin_bottom - (baseline * 2 + text_sz.height)),
+    color_black);
+  text_renderer_.draw(
+    canvas,
+    fps_text_,
     fps_stats_,
-    cv::Point(margin_left, frame.rows - margin_bottom - baseline + 4),
-    cv::FONT_HERSHEY_SIMPLEX,
-    font_scale,
-    color_black,
-#if defined(DRAW_WHITE_RECT)
-    thickness,
-#else
-    thickness + 1,
-#endif
-    LINE_TYPE);
-#if !defined(DRAW_WHITE_RECT)
-  cv::putText(
-    frame,
-    fps_stats_,
-    cv::Point(margin_left, frame.rows - margin_bottom - baseline + 4),
-    cv::FONT_HERSHEY_SIMPLEX,
-    font_scale,
-    color_white,
-    thickness,
-    LINE_TYPE);
-#endif
+    cv::Point(margin_left, canvas.height() - margin_bottom - baseline + 4),
+    color_black);
 
   return OK;
 }
@@ -21,7 +21,11 @@
 #ifndef inference_h
 #define inference_h
 
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <opencv2/core.hpp>
 #include <g2d.h>
@@ -30,6 +34,10 @@
 extern "C" {
 #include "imx_2d_device.h"
 }
+#include "canvas.h"
+#include "text_renderer.h"
+#include "thread_policy.h"
+#include "worker_pool.h"
 
 
 class inference_t
@@ -41,6 +49,16 @@ public:
     ERROR = -1,
   };
 
+  // thread count autotuner decision, times are windowed p50 in ms
+  struct autotune_decision_t {
+    int num_threads_;
+    double p50_;
+    int probed_threads_;
+    double probed_p50_;
+    bool switched_;
+  };
+  typedef std::function<void(const autotune_decision_t&)> autotune_callback_t;
+
   inference_t();
   virtual ~inference_t();
 
@@ -50,16 +68,72 @@ public:
   int clean_g2d(void);
 
   virtual int inference(void) = 0;
+  // decode the output tensors into results, right after inference(), so
+  // draw_results() can run while the next inference is in flight
+  virtual int parse_results(void) { return OK; }
   virtual int setup_input_tensor(
     GObject *object,
     GstVideoInfo *vinfo,
     Imx2DFrame *src_frame,
     Imx2DFrame *dst_frame);
-  virtual int calc_stats(cv::Mat& frame);
-  virtual int draw_stats(cv::Mat& frame);
-  virtual int draw_results(cv::Mat& frame) = 0;
+  // describe the BGRx staging buffer as a 2D device destination, so the
+  // model input resize can be submitted along with the display convert
+  int setup_input_frame(
+    int video_width,
+    int video_height,
+    Imx2DRotationMode rotate,
+    Imx2DFrame *frame);
+  // load the staging buffer into the input tensor, once the blit is done
+  int load_input_tensor(void);
+  // same from another BGRx buffer of input_frame_size() and the same layout
+  int load_input_tensor(const uint8_t *bgrx);
+  size_t input_frame_size(void) const { return bgrx_size_; }
+  // load a frame already at the model input size, RGB, BGRx or BGRA, from
+  // a second stream of the source, instead of resizing the source frame
+  int load_input_frame(
+    const uint8_t *data,
+    GstVideoFormat format,
+    int width,
+    int height,
+    int stride); // bytes
+  // resize a crop of the source (in source pixels) into dst, a buffer laid
+  // out as the staging buffer. Does not wait, several crops can be queued
+  // before a g2d_finish() on imx_g2d_get_thread_handle()
+  int blit_input_crop(
+    GstVideoInfo *vinfo,
+    Imx2DFrame *src_frame,
+    const cv::Rect& crop,
+    g2d_buf *dst);
+  // true when setup_input_tensor() reads more of the source than the
+  // model input, so it can't be replaced by setup_input_frame()
+  virtual bool needs_source_frame(void) const { return false; }
+  virtual int calc_stats(canvas_t& canvas);
+  virtual int draw_stats(canvas_t& canvas);
+  virtual int draw_results(canvas_t& canvas) = 0;
+  // stream time of the frames, in seconds, for results filtered over time:
+  // set_input_time() before the model input is loaded, set_draw_time()
+  // before draw_results()
+  void set_input_time(double t) { input_time_ = t; }
+  void set_draw_time(double t) { draw_time_ = t; }
+  // per pixel results, drawn as BGRA (premultiplied alpha) at the returned
+  // size then scaled over the whole output by the 2D device. false when the
+  // head has no mask
+  virtual bool get_mask_size(int *width, int *height) { return false; }
+  virtual int draw_mask(uint8_t *bgra, int stride) { return ERROR; }
   virtual int get_input_tensor_shape(std::vector<int> *shape) = 0;
   virtual int get_input_tensor(uint8_t **ptr, size_t* sz) { return ERROR; }
+  // runtime settings, taken by the thread running inference() before its
+  // next run, so they apply without re-creating the runtime
+  virtual int set_num_threads(int num_threads) { return ERROR; }
+  // thread count of the next run, also when picked by the autotuner
+  virtual int get_num_threads(void) { return ERROR; }
+  virtual void set_thread_policy(const thread_policy_t& policy);
+  // the callback is called from the thread running inference(), set it
+  // before the first run
+  virtual int set_autotune(bool enable) { return ERROR; }
+  virtual void set_autotune_callback(const autotune_callback_t& callback) {}
+  // CPU stages are split across pool, serial without one
+  virtual void set_worker_pool(const std::shared_ptr<worker_pool_t>& pool);
   virtual int copy_data_to_input_tensor(uint8_t *data, size_t sz) { return ERROR; }
 
   int setup_g2d_surface(
@@ -70,7 +144,8 @@ public:
     Imx2DRotationMode rotate,
     struct g2d_surface *s);
 
-  double inference_time_cur_ = 0;
+  // written by the thread running inference(), read for the stats
+  std::atomic<double> inference_time_cur_{0};
 
   int video_width_ = 0;
   int video_height_ = 0;
@@ -79,13 +154,49 @@ public:
   int bgrx_height_ = 0;
   int bgrx_channels_ = 0;
 
+protected:
+
+  // shared glyph atlas for stats and results text
+  text_renderer_t text_renderer_;
+
+  // guards the parsed results between parse_results() and draw_results()
+  std::mutex results_mutex_;
+
+  // time of the frame the model input holds, only set while no inference
+  // is in flight, and of the frame being drawn
+  double input_time_ = 0;
+  double draw_time_ = 0;
+
+  // true once after each set_thread_policy()
+  bool get_thread_policy(thread_policy_t *policy);
+
+  // calls body(begin, end) over [0, n), in chunks of at least grain, on
+  // the worker pool. Can be nested, and called from any thread
+  void parallel_for(
+    int n,
+    int grain,
+    const std::function<void(int, int)>& body);
+
 private:
 
-  // g2d for resize
-  void *g2d_handle_ = NULL;
+  // g2d for resize, the handle is per thread (imx_g2d_get_thread_handle)
   g2d_buf *bgrx_buf_ = NULL;
   int bgrx_stride_ = 0;
   size_t bgrx_size_ = 0;
+  PhyMemBlock bgrx_mem_ = {0};
+
+  // BGRx rows of stride bytes into the RGB input, bgrx_width_ x bgrx_height_
+  void bgrx_to_rgb(
+    const uint8_t *bgrx,
+    uint8_t *rgb,
+    int stride);
+
+  std::mutex worker_pool_mutex_;
+  std::shared_ptr<worker_pool_t> worker_pool_;
+
+  std::mutex thread_policy_mutex_;
+  thread_policy_t thread_policy_;
+  bool thread_policy_changed_ = false;
 
   // measure fps
   std::chrono::steady_clock::time_point start_time_;
@@ -95,8 +206,11 @@ private:
   double inference_time_total_;
   double inference_time_avg_;
   // stats
+  std::chrono::steady_clock::time_point stats_update_time_;
   std::string fps_stats_;
   std::string inference_stats_;
+  text_renderer_t::cached_text_t fps_text_;
+  text_renderer_t::cached_text_t inference_text_;
   int stats_initialized_ = 0;
 
   // unused
@@ -0,0 +1,116 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "inference_worker.h"
+#include <gst/gst.h>
+
+GST_DEBUG_CATEGORY(inference_worker_t_debug);
+#define GST_CAT_DEFAULT inference_worker_t_debug
+
+
+inference_worker_t::inference_worker_t(inference_t *inference)
+  : inference_(inference)
+{
+  GST_DEBUG_CATEGORY_INIT(inference_worker_t_debug, "inference_worker_t", 0, "i.MX NN Inference demo inference worker class");
+  GST_TRACE("%s", __func__);
+
+  thread_ = std::thread(&inference_worker_t::worker, this);
+}
+
+inference_worker_t::~inference_worker_t()
+{
+  GST_TRACE("%s", __func__);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+}
+
+bool
+inference_worker_t::busy()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return busy_;
+}
+
+int
+inference_worker_t::submit(void)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (busy_ || stop_) {
+      return ERROR;
+    }
+    busy_ = true;
+    submit_time_ = std::chrono::steady_clock::now();
+  }
+  cond_.notify_all();
+  return OK;
+}
+
+void
+inference_worker_t::wait(void)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [&] { return !busy_; });
+}
+
+double
+inference_worker_t::get_latency()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return latency_;
+}
+
+void
+inference_worker_t::worker(void)
+{
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [&] { return stop_ || busy_; });
+      if (stop_) {
+        return;
+      }
+    }
+
+    if (inference_->inference() == inference_t::OK) {
+      inference_->parse_results();
+    } else {
+      GST_WARNING("inference failed");
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::chrono::duration<double, std::milli> latency =
+        std::chrono::steady_clock::now() - submit_time_;
+      latency_ = latency.count();
+      busy_ = false;
+    }
+    cond_.notify_all();
+  }
+}
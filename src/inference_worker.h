@@ -0,0 +1,78 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef inference_worker_h
+#define inference_worker_h
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "inference.h"
+
+// Runs inference() and parse_results() of an inference_t on its own thread.
+// There is a single request slot: submit() is refused while a request is in
+// flight, so the model always starts on the freshest frame and stale frames
+// are dropped instead of queued.
+class inference_worker_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  explicit inference_worker_t(inference_t *inference);
+  virtual ~inference_worker_t();
+
+  bool busy();
+
+  // start inference on the input tensor as loaded by the caller, the caller
+  // must not touch the input tensor until busy() is false again
+  int submit(void);
+
+  // blocks until the request in flight, if any, is done
+  void wait(void);
+
+  // time from submit() to parsed results of the last request, in ms
+  double get_latency();
+
+private:
+
+  void worker(void);
+
+  inference_t *inference_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // guarded by mutex_
+  bool busy_ = false;
+  bool stop_ = false;
+  std::chrono::steady_clock::time_point submit_time_;
+  double latency_ = 0;
+
+  // unused
+  inference_worker_t(const inference_worker_t&);
+  inference_worker_t& operator=(const inference_worker_t&);
+
+};
+
+#endif
@@ -0,0 +1,132 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "label_table.h"
+#include <gst/gst.h>
+#include <fstream>
+#include <map>
+#include <cstdlib>
+
+GST_DEBUG_CATEGORY(label_table_t_debug);
+#define GST_CAT_DEFAULT label_table_t_debug
+
+
+label_table_t::label_table_t()
+{
+  GST_DEBUG_CATEGORY_INIT(label_table_t_debug, "label_table_t", 0, "i.MX NN Inference demo label table class");
+  GST_TRACE("%s", __func__);
+  build_entry(unknown_, "unknown");
+}
+
+label_table_t::~label_table_t()
+{
+  GST_TRACE("%s", __func__);
+}
+
+void
+label_table_t::build_entry(
+  entry_t& entry,
+  const std::string& name)
+{
+  entry.name_ = name;
+  char buf[256];
+  for (int i = 0; i < NUM_SCORE_BUCKETS; i++) {
+    snprintf(buf, sizeof(buf), "%s: %d%%", name.c_str(), i);
+    text_t& text = entry.text_[i];
+    text.str_ = buf;
+    text.baseline_ = 0;
+    if (renderer_) {
+      text.size_ = renderer_->get_text_size(text.str_, &text.baseline_);
+    } else {
+      text.size_ = cv::getTextSize(text.str_, cv::FONT_HERSHEY_SIMPLEX, 0.7, 2, &text.baseline_);
+    }
+  }
+}
+
+int
+label_table_t::load(
+  const std::string& filename,
+  const text_renderer_t& renderer)
+{
+  GST_TRACE("%s", __func__);
+
+  renderer_ = &renderer;
+  entries_.clear();
+  index_.clear();
+  build_entry(unknown_, "unknown");
+
+  std::ifstream file(filename);
+  if (!file) {
+    GST_ERROR ("Failed to open %s", filename.c_str());
+    return ERROR;
+  }
+
+  // intern label names, several ids may share one entry
+  std::map<std::string, const entry_t*> interned;
+  std::string line;
+  for (long line_number = 0; std::getline(file, line); line_number++) {
+    // "<id>  <name>", otherwise the whole line names id line_number
+    long id = line_number;
+    std::string name = line;
+    std::size_t found = line.find("  ");
+    if (found != std::string::npos) {
+      std::string id_str = line.substr(0, found);
+      char *end = NULL;
+      long explicit_id = strtol(id_str.c_str(), &end, 10);
+      if ((end != id_str.c_str()) && (*end == '\0')) {
+        id = explicit_id;
+        name = line.substr(found + 2);
+      }
+    }
+    if ((id < 0) || (id > MAX_LABEL_ID)) {
+      GST_WARNING("Ignoring out of range label id %ld", id);
+      continue;
+    }
+    // trailing CR of DOS files and padding are not part of the name
+    name.erase(name.find_last_not_of(" \t\r") + 1);
+    if (name.empty()) {
+      GST_DEBUG("no label for id %ld", id);
+      continue;
+    }
+
+    const entry_t* entry = NULL;
+    auto it = interned.find(name);
+    if (it != interned.end()) {
+      entry = it->second;
+    } else {
+      entries_.emplace_back();
+      build_entry(entries_.back(), name);
+      entry = &entries_.back();
+      interned.emplace(name, entry);
+    }
+
+    if (id >= (int)index_.size()) {
+      index_.resize(id + 1, NULL);
+    }
+    index_[id] = entry;
+  }
+
+  GST_DEBUG("%zu label ids, %zu distinct labels", index_.size(), entries_.size());
+  return OK;
+}
@@ -0,0 +1,112 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef label_table_h
+#define label_table_h
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "text_renderer.h"
+
+// Dense, id-indexed label table.
+// Every "<label>: <score>%" string and its text extent is built once at
+// load time, so looking up a detection label never allocates. Extents are
+// measured with the renderer that draws the labels, so boxes fit the text.
+class label_table_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  // score buckets, 0% .. 100%
+  static const int NUM_SCORE_BUCKETS = 101;
+  // bounds the dense index
+  static const int MAX_LABEL_ID = 65535;
+
+  struct text_t {
+    std::string str_;
+    cv::Size size_;
+    int baseline_;
+  };
+
+  struct entry_t {
+    std::string name_;
+    text_t text_[NUM_SCORE_BUCKETS];
+  };
+
+  label_table_t();
+  virtual ~label_table_t();
+
+  // "<id>  <name>" lines, or one name per line for ids 0, 1, ... (the
+  // line number). The renderer must be initialized and outlive the table
+  int load(
+    const std::string& filename,
+    const text_renderer_t& renderer);
+
+  // returns the "unknown" entry for ids without a label
+  const entry_t& get(int id) const
+  {
+    if ((id >= 0) && (id < (int)index_.size()) && index_[id]) {
+      return *index_[id];
+    }
+    return unknown_;
+  }
+
+  const text_t& get_text(int id, float score) const
+  {
+    int bucket = (int)(score * 100);
+    if (bucket < 0) {
+      bucket = 0;
+    } else if (bucket >= NUM_SCORE_BUCKETS) {
+      bucket = NUM_SCORE_BUCKETS - 1;
+    }
+    return get(id).text_[bucket];
+  }
+
+  size_t size() const { return index_.size(); }
+
+private:
+
+  void build_entry(
+    entry_t& entry,
+    const std::string& name);
+
+  // interned entries, one per distinct label name
+  std::deque<entry_t> entries_;
+  // id -> entry (NULL if the id has no label)
+  std::vector<const entry_t*> index_;
+  entry_t unknown_;
+
+  // NULL until load(), then extents come from the renderer
+  const text_renderer_t* renderer_ = NULL;
+
+  // unused
+  label_table_t(const label_table_t&);
+  label_table_t& operator=(const label_table_t&);
+
+};
+
+#endif
@@ -0,0 +1,160 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "mask_layer.h"
+extern "C" {
+#include <gst/allocators/gstallocatorphymem.h>
+}
+
+GST_DEBUG_CATEGORY(mask_layer_t_debug);
+#define GST_CAT_DEFAULT mask_layer_t_debug
+
+
+mask_layer_t::mask_layer_t()
+{
+  GST_DEBUG_CATEGORY_INIT(mask_layer_t_debug, "mask_layer_t", 0, "i.MX NN Inference demo mask layer class");
+  GST_TRACE("%s", __func__);
+}
+
+mask_layer_t::~mask_layer_t()
+{
+  GST_TRACE("%s", __func__);
+  release();
+}
+
+void
+mask_layer_t::release(void)
+{
+  if (mapped_) {
+    gst_buffer_unmap(buffer_, &map_info_);
+    mapped_ = false;
+  }
+  if (buffer_) {
+    gst_buffer_unref(buffer_);
+    buffer_ = NULL;
+  }
+  width_ = 0;
+  height_ = 0;
+}
+
+int
+mask_layer_t::init(
+  Imx2DDevice *device,
+  GstAllocator *allocator,
+  int width,
+  int height)
+{
+  if (buffer_ && (device == device_) && (width == width_) && (height == height_)) {
+    return OK;
+  }
+
+  GST_TRACE("%s", __func__);
+  release();
+
+  if (!device || !allocator) {
+    GST_ERROR("Invalid device or allocator");
+    return ERROR;
+  }
+  if (!(device->get_capabilities(device) & IMX_2D_DEVICE_CAP_BLEND)) {
+    GST_WARNING("2D device can't blend, no mask");
+    return ERROR;
+  }
+  device_ = device;
+
+  // G2D takes the input stride from the width, so no padding
+  buffer_ = gst_buffer_new_allocate(allocator, (gsize)width * height * 4, NULL);
+  if (!buffer_ || !gst_buffer_is_phymem(buffer_)) {
+    GST_ERROR("Failed to allocate %dx%d mask", width, height);
+    release();
+    return ERROR;
+  }
+  width_ = width;
+  height_ = height;
+
+  GST_DEBUG("mask: %dx%d", width_, height_);
+  return OK;
+}
+
+uint8_t*
+mask_layer_t::begin(void)
+{
+  if (!buffer_) {
+    return NULL;
+  }
+  if (!mapped_) {
+    if (!gst_buffer_map(buffer_, &map_info_, GST_MAP_WRITE)) {
+      GST_ERROR("Failed to map mask");
+      return NULL;
+    }
+    mapped_ = true;
+  }
+  return map_info_.data;
+}
+
+int
+mask_layer_t::end(
+  Imx2DFrame *dst)
+{
+  if (!buffer_) {
+    return ERROR;
+  }
+  // flush CPU writes before the device reads the mask
+  if (mapped_) {
+    gst_buffer_unmap(buffer_, &map_info_);
+    mapped_ = false;
+  }
+
+  Imx2DFrame src = {0};
+  src.mem = gst_buffer_query_phymem_block(buffer_);
+  src.fd[0] = src.fd[1] = src.fd[2] = src.fd[3] = -1;
+  src.info.fmt = GST_VIDEO_FORMAT_BGRA;
+  src.info.w = width_;
+  src.info.h = height_;
+  src.info.stride = width_ * 4;
+  src.info.tile_type = IMX_2D_TILE_NULL;
+  src.crop.w = width_;
+  src.crop.h = height_;
+  src.rotate = IMX_2D_ROTATION_0;
+  src.interlace_type = IMX_2D_INTERLACE_PROGRESSIVE;
+  src.alpha = 0xFF;
+
+  if (!src.mem || (device_->config_input(device_, &src.info) != 0)) {
+    return ERROR;
+  }
+  // the model input is already in output orientation
+  if (device_->set_rotate(device_, IMX_2D_ROTATION_0) != 0) {
+    return ERROR;
+  }
+
+  Imx2DFrame blend_dst = *dst;
+  blend_dst.crop.x = 0;
+  blend_dst.crop.y = 0;
+  blend_dst.crop.w = dst->info.w;
+  blend_dst.crop.h = dst->info.h;
+  if (device_->blend(device_, &blend_dst, &src) != 0) {
+    return ERROR;
+  }
+  device_->blend_finish(device_);
+  return OK;
+}
@@ -0,0 +1,77 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef mask_layer_h
+#define mask_layer_h
+
+#include <gst/gst.h>
+extern "C" {
+#include "imx_2d_device.h"
+}
+
+// Low resolution mask plane.
+// Per pixel results are written as BGRA (premultiplied alpha) at model
+// resolution, then the 2D device scales and blends the whole mask over the
+// video frame, so the CPU never touches full resolution mask pixels. There
+// is no CPU fallback, init() fails if the device can't blend.
+class mask_layer_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  mask_layer_t();
+  virtual ~mask_layer_t();
+
+  // (re)allocate the mask, does nothing if the size is unchanged
+  int init(
+    Imx2DDevice *device,
+    GstAllocator *allocator,
+    int width,
+    int height);
+
+  // map the mask for writing, rows are width * 4 bytes
+  uint8_t* begin(void);
+
+  // scale and blend the mask over the whole dst crop
+  int end(
+    Imx2DFrame *dst);
+
+private:
+
+  void release(void);
+
+  Imx2DDevice *device_ = NULL;
+  GstBuffer *buffer_ = NULL;
+  GstMapInfo map_info_;
+  bool mapped_ = false;
+  int width_ = 0;
+  int height_ = 0;
+
+  // unused
+  mask_layer_t(const mask_layer_t&);
+  mask_layer_t& operator=(const mask_layer_t&);
+
+};
+
+#endif
@@ -26,11 +26,14 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc/imgproc_c.h>
-#include <fstream>
 
 GST_DEBUG_CATEGORY(mobilenet_ssd_t_debug);
 #define GST_CAT_DEFAULT mobilenet_ssd_t_debug
 
+#define LABEL_FONT_FACE (cv::FONT_HERSHEY_SIMPLEX)
+#define LABEL_FONT_SCALE (0.7)
+#define LABEL_THICKNESS (2)
+
 
 mobilenet_ssd_t::mobilenet_ssd_t()
 {
@@ -49,121 +52,128 @@ int mobilenet_ssd_t::init(
   int num_threads)
 {
   GST_TRACE("%s", __func__);
-  tflite_inference_t::init(model, use_nnapi, num_threads);
-  return OK;
-}
-
-int
-mobilenet_ssd_t::load_labels(
-  const std::string& filename)
-{
-  GST_TRACE("%s", __func__);
-
-  std::ifstream file(filename);
-  if (!file) {
-    GST_ERROR ("Failed to open %s", filename.c_str());
-    return ERROR;
+  int ret = tflite_inference_t::init(model, use_nnapi, num_threads);
+  if (ret != OK) {
+    return ret;
   }
-  std::string line;
-  while (std::getline(file, line)) {
-    std::size_t found = line.find("  ");
-    if (found != std::string::npos) {
-      std::string id = line.substr(0, found);
-      std::string label = line.substr(found + 2);
-      std::pair<int, std::string> label_pair(std::stoi(id), label);
-      label_.push_back(label_pair);
+
+  static const char *output_name[OUTPUT_COUNT] = {
+    "TFLite_Detection_PostProcess",
+    "TFLite_Detection_PostProcess:1",
+    "TFLite_Detection_PostProcess:2",
+    "TFLite_Detection_PostProcess:3",
+  };
+  for (int i = 0; i < OUTPUT_COUNT; i++) {
+    if (bind_output(output_name[i], i, outputs_[i]) != OK) {
+      return ERROR;
     }
   }
   return OK;
 }
 
 int
-mobilenet_ssd_t::get_label(
-  int id, std::string& label)
+mobilenet_ssd_t::load_labels(
+  const std::string& filename)
 {
-  auto it = std::find_if(label_.begin(), label_.end(),
-  [&id](const std::pair<int, std::string>& element){ return element.first == id;} );
-  if (it != label_.end()) {
-    label = it->second;
-    return OK;
-  }
-  return ERROR;
+  GST_TRACE("%s", __func__);
+  text_renderer_.init(LABEL_FONT_FACE, LABEL_FONT_SCALE, LABEL_THICKNESS);
+  return labels_.load(filename, text_renderer_);
 }
 
 int
 mobilenet_ssd_t::draw_mobilenet(
-  cv::Mat& frame,
-  float score,
-  const std::string& label,
+  canvas_t& canvas,
+  const label_table_t::text_t& text,
   float ymin,
   float xmin,
   float ymax,
   float xmax)
 {
-  cv::rectangle(frame, cv::Point(xmin, ymin), cv::Point(xmax, ymax), cv::Scalar(10, 255, 0), 4);
-
-  char buf[256];
-  if (label.length()) {
-    snprintf(buf, 256, "%s: %d%%", label.c_str(), (int)(score * 100));
-  }
-  else
-  {
-    snprintf(buf, 256, "unknown: %d%%", (int)(score * 100));
-  }
-
-  int baseline = 0;
-  cv::Size text_sz = cv::getTextSize(buf, cv::FONT_HERSHEY_SIMPLEX, 0.7, 2, &baseline);
+  canvas.rectangle(cv::Point(xmin, ymin), cv::Point(xmax, ymax), cv::Scalar(10, 255, 0), 4);
 
+  const cv::Size& text_sz = text.size_;
   int label_ymin = std::max((int)ymin, text_sz.height + 10);  // Make sure not to draw label too close to top of window
-  cv::rectangle(frame, cv::Point((int)xmin, label_ymin - text_sz.height - 10), cv::Point((int)xmin + text_sz.width, label_ymin + baseline - 10), cv::Scalar(255, 255, 255), cv::FILLED); // Draw white box to put label text in
-  cv::putText(frame, buf, cv::Point((int)xmin, label_ymin - 7), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 0, 0), 2);// Draw label text
+  canvas.rectangle(cv::Point((int)xmin, label_ymin - text_sz.height - 10), cv::Point((int)xmin + text_sz.width, label_ymin + text.baseline_ - 10), cv::Scalar(255, 255, 255), cv::FILLED); // Draw white box to put label text in
+  text_renderer_.draw(canvas, text.str_, cv::Point((int)xmin, label_ymin - 7), cv::Scalar(0, 0, 0));// Draw label text
 
   return OK;
 }
 
 int
 mobilenet_ssd_t::handle_mobilenet(
-  cv::Mat& frame,
-  float threshold,
+  canvas_t& canvas,
   int image_width,
   int image_height)
 {
-  size_t sz[4] = {0,};
-  float *mn_location = (float *)(typed_output_tensor<float>(0, &sz[0]));
-  float *mn_label = (float *)(typed_output_tensor<float>(1, &sz[1]));
-  float *mn_score = (float *)(typed_output_tensor<float>(2, &sz[2]));
-  float *mn_num_detect = (float *)(typed_output_tensor<float>(3, &sz[3]));
-
-  GST_TRACE("mn results: %p[%ld], %p[%ld], %p[%ld], %p[%ld]",
-        mn_location, sz[0],
-        mn_label, sz[1],
-        mn_score, sz[2],
-        mn_num_detect, sz[3]);
-
-  int num_detect = (int)(*mn_num_detect);
-  for (int i = 0; i < num_detect; i++) {
-    float score = mn_score[i];
-    if (score > threshold) {
-      int label_id = (int)mn_label[i];
-      std::string label_str("unknown");
-      get_label(label_id, label_str);
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  for (size_t i = 0; i < detections_.size(); i++) {
+    const detection_t& det = detections_[i];
+    // preformatted "<label>: <score>%", no allocation per detection
+    const label_table_t::text_t& text = labels_.get_text(det.label_, det.score_);
+
+    // Get the bbox, make sure its not out of the image bounds, and scale up to src image size
+    float ymin = std::fmax(0.0f, det.ymin_ * image_height);
+    float xmin = std::fmax(0.0f, det.xmin_ * image_width);
+    float ymax = std::fmin(float(image_height - 1), det.ymax_ * image_height);
+    float xmax = std::fmin(float(image_width - 1), det.xmax_ * image_width);
+
+    draw_mobilenet(canvas, text, ymin, xmin, ymax, xmax);
+  }
+  return OK;
+}
 
-      // Get the bbox, make sure its not out of the image bounds, and scale up to src image size
-      float ymin = std::fmax(0.0f, mn_location[4 * i] * image_height);
-      float xmin = std::fmax(0.0f, mn_location[4 * i + 1] * image_width);
-      float ymax = std::fmin(float(image_height - 1), mn_location[4 * i + 2] * image_height);
-      float xmax = std::fmin(float(image_width - 1), mn_location[4 * i + 3] * image_width);
+int mobilenet_ssd_t::parse_results(void)
+{
+  GST_TRACE("%s", __func__);
+  float threshold = 0.49;
 
-      draw_mobilenet(frame, score, label_str, ymin, xmin, ymax, xmax);
+  const output_tensor_t& mn_location = outputs_[OUTPUT_LOCATION];
+  const output_tensor_t& mn_label = outputs_[OUTPUT_LABEL];
+  const output_tensor_t& mn_score = outputs_[OUTPUT_SCORE];
+  const output_tensor_t& mn_num_detect = outputs_[OUTPUT_NUM_DETECT];
+  if (!mn_num_detect.bound()) {
+    return ERROR;
+  }
+
+  GST_TRACE("mn results: [%zu], [%zu], [%zu], [%zu]",
+        mn_location.length(), mn_label.length(),
+        mn_score.length(), mn_num_detect.length());
+
+  // only the boxes and labels of the detections kept are dequantized
+  parsed_.clear();
+  int num_detect = (int)mn_num_detect.get(0);
+  num_detect = std::min(num_detect, (int)std::min(mn_score.length(), mn_label.length()));
+  num_detect = std::min(num_detect, (int)(mn_location.length() / 4));
+  for (int i = 0; i < num_detect; i++) {
+    float score = mn_score.get(i);
+    if (score > threshold) {
+      float box[4];
+      mn_location.get(4 * i, 4, box);
+      detection_t det;
+      det.label_ = (int)mn_label.get(i);
+      det.score_ = score;
+      det.ymin_ = box[0];
+      det.xmin_ = box[1];
+      det.ymax_ = box[2];
+      det.xmax_ = box[3];
+      parsed_.push_back(det);
     }
   }
+
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  detections_.swap(parsed_);
   return OK;
 }
 
-int mobilenet_ssd_t::draw_results(cv::Mat& frame)
+void mobilenet_ssd_t::get_detections(std::vector<detection_t>& detections)
+{
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  detections = detections_;
+}
+
+int mobilenet_ssd_t::draw_results(canvas_t& canvas)
 {
   GST_TRACE("%s", __func__);
-  float threshold = 0.49;
-  handle_mobilenet(frame, threshold, frame.cols, frame.rows);
+  handle_mobilenet(canvas, canvas.width(), canvas.height());
   return OK;
 }
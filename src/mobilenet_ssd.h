@@ -22,6 +22,7 @@
 #define mobilenet_ssd_h
 
 #include "tflite_inference.h"
+#include "label_table.h"
 
 class mobilenet_ssd_t : public tflite_inference_t
 {
@@ -43,30 +44,60 @@ public:
   virtual int load_labels(
     const std::string& label);
 
-  virtual int draw_results(cv::Mat& frame);
+  // detection above threshold, box normalized to [0, 1]
+  struct detection_t {
+    int label_;
+    float score_;
+    float ymin_;
+    float xmin_;
+    float ymax_;
+    float xmax_;
+  };
+
+  virtual int parse_results(void);
+  virtual int draw_results(canvas_t& canvas);
 
-  int get_label(int id, std::string& label);
+  // last parsed detections
+  void get_detections(std::vector<detection_t>& detections);
 
-  std::vector<std::pair<int, std::string>> label_;
+  const label_table_t::entry_t& get_label(int id) const
+  {
+    return labels_.get(id);
+  }
 
+  label_table_t labels_;
 
   int draw_mobilenet(
-    cv::Mat& frame,
-    float score,
-    const std::string& label,
+    canvas_t& canvas,
+    const label_table_t::text_t& text,
     float ymin,
     float xmin,
     float ymax,
     float xmax);
 
   int handle_mobilenet(
-    cv::Mat& frame,
-    float threshold,
+    canvas_t& canvas,
     int image_width,
     int image_height);
 
 private:
 
+  // TFLite_Detection_PostProcess outputs
+  enum {
+    OUTPUT_LOCATION,
+    OUTPUT_LABEL,
+    OUTPUT_SCORE,
+    OUTPUT_NUM_DETECT,
+    OUTPUT_COUNT,
+  };
+  output_tensor_t outputs_[OUTPUT_COUNT];
+
+  // guarded by results_mutex_
+  std::vector<detection_t> detections_;
+  // parse_results() fills this one, then swaps it with detections_, so
+  // both keep their capacity across inferences
+  std::vector<detection_t> parsed_;
+
   // unused
   mobilenet_ssd_t(const mobilenet_ssd_t&);
   mobilenet_ssd_t& operator=(const mobilenet_ssd_t&);
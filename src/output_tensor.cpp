@@ -0,0 +1,105 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "output_tensor.h"
+#include "utils.h"
+#include <gst/gst.h>
+#include <algorithm>
+#include <string.h>
+
+GST_DEBUG_CATEGORY(output_tensor_t_debug);
+#define GST_CAT_DEFAULT output_tensor_t_debug
+
+
+output_tensor_t::output_tensor_t()
+{
+  GST_DEBUG_CATEGORY_INIT(output_tensor_t_debug, "output_tensor_t", 0, "i.MX NN Inference demo output tensor class");
+}
+
+output_tensor_t::~output_tensor_t()
+{
+}
+
+int
+output_tensor_t::bind(
+  const TfLiteTensor *tensor)
+{
+  data_ = NULL;
+  if (!tensor || !tensor->data.raw) {
+    GST_ERROR("Output tensor not allocated");
+    return ERROR;
+  }
+  if ((tensor->type != kTfLiteFloat32) && (tensor->type != kTfLiteUInt8) &&
+      (tensor->type != kTfLiteInt8)) {
+    GST_ERROR("Unsupported output tensor type %d for %s", tensor->type,
+        tensor->name ? tensor->name : "");
+    return ERROR;
+  }
+
+  length_ = 0;
+  TfLiteIntArray *dims = tensor->dims;
+  if (dims && dims->size && dims->data[0]) {
+    length_ = 1;
+    for (int i = 0; i < dims->size; i++) {
+      length_ *= dims->data[i];
+    }
+  }
+  type_ = tensor->type;
+  scale_ = 1.0f;
+  zero_point_ = 0;
+  if (type_ != kTfLiteFloat32) {
+    scale_ = tensor->params.scale;
+    zero_point_ = tensor->params.zero_point;
+  }
+  data_ = tensor->data.raw;
+
+  GST_DEBUG("output %s: type %d, %zu elements, scale %f, zero point %d",
+      tensor->name ? tensor->name : "", type_, length_, scale_, zero_point_);
+  return OK;
+}
+
+size_t
+output_tensor_t::get(
+  size_t i,
+  size_t n,
+  float *dst) const
+{
+  if (i >= length_) {
+    return 0;
+  }
+  n = std::min(n, length_ - i);
+
+  switch (type_) {
+  case kTfLiteUInt8:
+    utils::dequantize_u8((const uint8_t *)data_ + i, dst, n, scale_, zero_point_);
+    break;
+  case kTfLiteInt8:
+    utils::dequantize_s8((const int8_t *)data_ + i, dst, n, scale_, zero_point_);
+    break;
+  default:
+    memcpy(dst, (const float *)data_ + i, n * sizeof(float));
+    break;
+  }
+  return n;
+}
@@ -0,0 +1,78 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef output_tensor_h
+#define output_tensor_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tensorflow/lite/interpreter.h"
+
+// Output tensor bound once the interpreter tensors are allocated: data,
+// type, length and quantization are resolved there, so postprocessing reads
+// float32, uint8 or int8 outputs alike and only dequantizes the values it
+// actually uses.
+class output_tensor_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  output_tensor_t();
+  virtual ~output_tensor_t();
+
+  int bind(const TfLiteTensor *tensor);
+
+  bool bound(void) const { return data_ != NULL; }
+  TfLiteType type(void) const { return type_; }
+  // number of elements
+  size_t length(void) const { return length_; }
+
+  // dequantized element i
+  float get(size_t i) const
+  {
+    switch (type_) {
+    case kTfLiteUInt8:
+      return scale_ * (((const uint8_t *)data_)[i] - zero_point_);
+    case kTfLiteInt8:
+      return scale_ * (((const int8_t *)data_)[i] - zero_point_);
+    default:
+      return ((const float *)data_)[i];
+    }
+  }
+
+  // dequantize n elements from i, clipped to the tensor length, returns
+  // how many were read
+  size_t get(size_t i, size_t n, float *dst) const;
+
+private:
+
+  const void *data_ = NULL;
+  TfLiteType type_ = kTfLiteNoType;
+  size_t length_ = 0;
+  float scale_ = 1.0f;
+  int zero_point_ = 0;
+
+};
+
+#endif
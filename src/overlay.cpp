@@ -0,0 +1,276 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "overlay.h"
+#include "utils.h"
+extern "C" {
+#include <gst/allocators/gstallocatorphymem.h>
+}
+
+GST_DEBUG_CATEGORY(overlay_t_debug);
+#define GST_CAT_DEFAULT overlay_t_debug
+
+
+overlay_t::overlay_t()
+{
+  GST_DEBUG_CATEGORY_INIT(overlay_t_debug, "overlay_t", 0, "i.MX NN Inference demo overlay class");
+  GST_TRACE("%s", __func__);
+}
+
+overlay_t::~overlay_t()
+{
+  GST_TRACE("%s", __func__);
+  release();
+}
+
+void
+overlay_t::release(void)
+{
+  unmap();
+  if (canvas_) {
+    delete canvas_;
+    canvas_ = NULL;
+  }
+  if (buffer_) {
+    gst_buffer_unref(buffer_);
+    buffer_ = NULL;
+  }
+  drawn_rects_.clear();
+  width_ = 0;
+  height_ = 0;
+}
+
+int
+overlay_t::init(
+  Imx2DDevice *device,
+  GstAllocator *allocator,
+  int width,
+  int height)
+{
+  if (buffer_ && (device == device_) && (width == width_) && (height == height_)) {
+    return OK;
+  }
+
+  GST_TRACE("%s", __func__);
+  release();
+
+  if (!device || !allocator) {
+    GST_ERROR("Invalid device or allocator");
+    return ERROR;
+  }
+  device_ = device;
+  use_device_ = (device_->get_capabilities(device_) & IMX_2D_DEVICE_CAP_BLEND) != 0;
+
+  // G2D takes the input stride from the width, so no padding
+  gsize size = (gsize)width * height * 4;
+  buffer_ = gst_buffer_new_allocate(allocator, size, NULL);
+  if (!buffer_ || !gst_buffer_is_phymem(buffer_)) {
+    GST_ERROR("Failed to allocate %dx%d overlay", width, height);
+    release();
+    return ERROR;
+  }
+  width_ = width;
+  height_ = height;
+
+  // start fully transparent
+  if (map(GST_MAP_WRITE) != OK) {
+    release();
+    return ERROR;
+  }
+  memset(map_info_.data, 0, size);
+  unmap();
+
+  GST_DEBUG("overlay: %dx%d, device blend: %d", width_, height_, use_device_);
+  return OK;
+}
+
+int
+overlay_t::map(GstMapFlags flags)
+{
+  if (mapped_) {
+    return OK;
+  }
+  if (!gst_buffer_map(buffer_, &map_info_, flags)) {
+    GST_ERROR("Failed to map overlay");
+    return ERROR;
+  }
+  mapped_ = true;
+  surface_ = cv::Mat(height_, width_, CV_8UC4, map_info_.data);
+  return OK;
+}
+
+void
+overlay_t::unmap(void)
+{
+  if (!mapped_) {
+    return;
+  }
+  surface_ = cv::Mat();
+  gst_buffer_unmap(buffer_, &map_info_);
+  mapped_ = false;
+}
+
+canvas_t*
+overlay_t::begin(void)
+{
+  if (!buffer_) {
+    return NULL;
+  }
+  if (map((GstMapFlags)(GST_MAP_READ | GST_MAP_WRITE)) != OK) {
+    return NULL;
+  }
+
+  // only erase what the previous frame drew, the rest is still transparent
+  for (size_t i = 0; i < drawn_rects_.size(); i++) {
+    surface_(drawn_rects_[i]).setTo(cv::Scalar::all(0));
+  }
+  drawn_rects_.clear();
+
+  if (canvas_) {
+    canvas_->reset(surface_);
+  } else {
+    canvas_ = new mat_canvas_t(surface_, true);
+  }
+  return canvas_;
+}
+
+int
+overlay_t::end(
+  Imx2DFrame *dst,
+  GstVideoFrame *out,
+  const Imx2DFrame *src)
+{
+  // begin() maps the surface
+  if (!canvas_ || !mapped_) {
+    return ERROR;
+  }
+
+  drawn_rects_ = canvas_->get_dirty_rects();
+  canvas_->clear_dirty_rects();
+  // flush CPU writes before the device reads the surface
+  unmap();
+
+  if (drawn_rects_.empty()) {
+    return OK;
+  }
+
+  size_t done = 0;
+  if (use_device_) {
+    // the blend reconfigures the device input and rotation, restore them
+    // for whoever converts next
+    Imx2DRotationMode rotate = device_->get_rotate(device_);
+    int ret = blend_device(dst, drawn_rects_, &done);
+    device_->set_rotate(device_, rotate);
+    if (src) {
+      Imx2DVideoInfo src_info = src->info;
+      device_->config_input(device_, &src_info);
+    }
+    if (ret == OK) {
+      return OK;
+    }
+    GST_WARNING("Device blend failed, falling back to CPU blend");
+    use_device_ = false;
+  }
+
+  return blend_cpu(out, drawn_rects_, done);
+}
+
+int
+overlay_t::blend_device(
+  Imx2DFrame *dst,
+  const std::vector<cv::Rect>& rects,
+  size_t *done)
+{
+  Imx2DFrame src = {0};
+  src.mem = gst_buffer_query_phymem_block(buffer_);
+  src.fd[0] = src.fd[1] = src.fd[2] = src.fd[3] = -1;
+  src.info.fmt = GST_VIDEO_FORMAT_BGRA;
+  src.info.w = width_;
+  src.info.h = height_;
+  src.info.stride = width_ * 4;
+  src.info.tile_type = IMX_2D_TILE_NULL;
+  src.rotate = IMX_2D_ROTATION_0;
+  src.interlace_type = IMX_2D_INTERLACE_PROGRESSIVE;
+  src.alpha = 0xFF;
+
+  if (!src.mem || (device_->config_input(device_, &src.info) != 0)) {
+    return ERROR;
+  }
+  // the surface is drawn in output coordinates, already rotated
+  if (device_->set_rotate(device_, IMX_2D_ROTATION_0) != 0) {
+    return ERROR;
+  }
+
+  // the caller's dst crop is left as is
+  Imx2DFrame blend_dst = *dst;
+  int ret = OK;
+  for (*done = 0; *done < rects.size(); (*done)++) {
+    const cv::Rect& rect = rects[*done];
+    src.crop.x = blend_dst.crop.x = rect.x;
+    src.crop.y = blend_dst.crop.y = rect.y;
+    src.crop.w = blend_dst.crop.w = rect.width;
+    src.crop.h = blend_dst.crop.h = rect.height;
+    if (device_->blend(device_, &blend_dst, &src) != 0) {
+      ret = ERROR;
+      break;
+    }
+  }
+  // also completes the rects queued before a failure
+  device_->blend_finish(device_);
+
+  GST_TRACE("blended %zu of %zu rects", *done, rects.size());
+  return ret;
+}
+
+int
+overlay_t::blend_cpu(
+  GstVideoFrame *out,
+  const std::vector<cv::Rect>& rects,
+  size_t first)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT(out);
+  if ((format != GST_VIDEO_FORMAT_BGRx) && (format != GST_VIDEO_FORMAT_BGRA)) {
+    GST_WARNING("CPU blend not supported for %s", gst_video_format_to_string(format));
+    return ERROR;
+  }
+  if (map(GST_MAP_READ) != OK) {
+    return ERROR;
+  }
+
+  uint8_t *data = (uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(out, 0);
+  int stride = GST_VIDEO_FRAME_PLANE_STRIDE(out, 0);
+  cv::Rect bounds(0, 0, GST_VIDEO_FRAME_WIDTH(out), GST_VIDEO_FRAME_HEIGHT(out));
+  for (size_t i = first; i < rects.size(); i++) {
+    cv::Rect rect = rects[i] & bounds;
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+      utils::blend_bgra_premul_row(
+        data + y * stride + rect.x * 4,
+        surface_.ptr<uint8_t>(y) + rect.x * 4,
+        rect.width);
+    }
+  }
+
+  unmap();
+  return OK;
+}
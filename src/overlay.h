@@ -0,0 +1,96 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef overlay_h
+#define overlay_h
+
+#include <vector>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv2/core.hpp>
+extern "C" {
+#include "imx_2d_device.h"
+}
+#include "canvas.h"
+
+// Overlay plane.
+// Results and stats are drawn into a BGRA (premultiplied alpha) surface
+// allocated from the 2D device, then only the dirty rects are composited
+// into the video frame with Imx2DDevice::blend, so the video itself is never
+// touched by the CPU. If the device can't blend, the dirty rects are blended
+// by CPU instead (32bit RGB output only).
+class overlay_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  overlay_t();
+  virtual ~overlay_t();
+
+  // (re)allocate the surface, does nothing if the size is unchanged
+  int init(
+    Imx2DDevice *device,
+    GstAllocator *allocator,
+    int width,
+    int height);
+
+  // erase what was drawn for the previous frame and return the canvas
+  canvas_t* begin(void);
+
+  // composite the dirty rects into dst, out is the mapped dst frame.
+  // src (may be NULL) is the input the device was configured for, it is
+  // configured again after blending, as is the rotation.
+  int end(
+    Imx2DFrame *dst,
+    GstVideoFrame *out,
+    const Imx2DFrame *src);
+
+private:
+
+  void release(void);
+  int map(GstMapFlags flags);
+  void unmap(void);
+  int blend_device(Imx2DFrame *dst, const std::vector<cv::Rect>& rects, size_t *done);
+  int blend_cpu(GstVideoFrame *out, const std::vector<cv::Rect>& rects, size_t first);
+
+  Imx2DDevice *device_ = NULL;
+  GstBuffer *buffer_ = NULL;
+  GstMapInfo map_info_;
+  bool mapped_ = false;
+  int width_ = 0;
+  int height_ = 0;
+  cv::Mat surface_;
+  // allocated once, retargeted to the surface by begin()
+  mat_canvas_t *canvas_ = NULL;
+  // rects drawn for the previous frame, erased by begin()
+  std::vector<cv::Rect> drawn_rects_;
+  bool use_device_ = true;
+
+  // unused
+  overlay_t(const overlay_t&);
+  overlay_t& operator=(const overlay_t&);
+
+};
+
+#endif
@@ -0,0 +1,248 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "pose_tracker.h"
+#include <algorithm>
+#include <cmath>
+#include <gst/gst.h>
+
+GST_DEBUG_CATEGORY(pose_tracker_t_debug);
+#define GST_CAT_DEFAULT pose_tracker_t_debug
+
+// One Euro parameters, positions in model input pixels
+#define FILTER_MIN_CUTOFF (1.0f)
+#define FILTER_BETA (0.05f)
+#define FILTER_D_CUTOFF (1.0f)
+// keypoints below this score don't move the filter
+#define KEYPOINT_SCORE_MIN (0.2f)
+// match when the mean keypoint distance is below this fraction of the
+// tracked pose size
+#define MATCH_DISTANCE_RATIO (0.5f)
+#define MATCH_DISTANCE_MIN (8.0f)
+// updates a track survives without a match
+#define TRACK_MISSED_MAX (2)
+// no extrapolation further than this, seconds
+#define PREDICT_HORIZON_MAX (0.3)
+
+
+static inline float
+smoothing_factor(
+  float dt,
+  float cutoff)
+{
+  float r = 2 * (float)M_PI * cutoff * dt;
+  return r / (r + 1);
+}
+
+float
+one_euro_filter_t::filter(
+  float x,
+  float dt,
+  float min_cutoff,
+  float beta,
+  float d_cutoff)
+{
+  if (!initialized_ || (dt <= 0)) {
+    if (!initialized_) {
+      x_ = x;
+      dx_ = 0;
+      initialized_ = true;
+    }
+    return x_;
+  }
+
+  float a_d = smoothing_factor(dt, d_cutoff);
+  dx_ = a_d * ((x - x_) / dt) + (1 - a_d) * dx_;
+
+  float a = smoothing_factor(dt, min_cutoff + beta * std::fabs(dx_));
+  x_ = a * x + (1 - a) * x_;
+  return x_;
+}
+
+
+pose_tracker_t::pose_tracker_t()
+{
+  GST_DEBUG_CATEGORY_INIT(pose_tracker_t_debug, "pose_tracker_t", 0, "i.MX NN Inference demo pose tracker class");
+  GST_TRACE("%s", __func__);
+}
+
+pose_tracker_t::~pose_tracker_t()
+{
+  GST_TRACE("%s", __func__);
+}
+
+void
+pose_tracker_t::reset(void)
+{
+  tracks_.clear();
+}
+
+float
+pose_tracker_t::distance(
+  const pose_structure& a,
+  const pose_structure& b)
+{
+  // mean distance over the keypoints seen in both
+  float sum = 0;
+  int n = 0;
+  for (int i = 0; i < POSE_NUM_KEYPOINTS; i++) {
+    if ((a.pt_[i].score_ < KEYPOINT_SCORE_MIN) || (b.pt_[i].score_ < KEYPOINT_SCORE_MIN)) {
+      continue;
+    }
+    sum += std::hypot(a.pt_[i].x_ - b.pt_[i].x_, a.pt_[i].y_ - b.pt_[i].y_);
+    n++;
+  }
+  return n ? (sum / n) : INFINITY;
+}
+
+float
+pose_tracker_t::size(
+  const pose_structure& pose)
+{
+  // diagonal of the visible keypoints bounding box
+  float xmin = INFINITY, ymin = INFINITY, xmax = -INFINITY, ymax = -INFINITY;
+  for (int i = 0; i < POSE_NUM_KEYPOINTS; i++) {
+    if (pose.pt_[i].score_ < KEYPOINT_SCORE_MIN) {
+      continue;
+    }
+    xmin = std::min(xmin, pose.pt_[i].x_);
+    ymin = std::min(ymin, pose.pt_[i].y_);
+    xmax = std::max(xmax, pose.pt_[i].x_);
+    ymax = std::max(ymax, pose.pt_[i].y_);
+  }
+  if (xmax < xmin) {
+    return 0;
+  }
+  return std::hypot(xmax - xmin, ymax - ymin);
+}
+
+void
+pose_tracker_t::filter(
+  track_t& track,
+  const pose_structure& pose,
+  double t)
+{
+  float dt = (float)(t - track.time_);
+  track.pose_.score_ = pose.score_;
+  for (int i = 0; i < POSE_NUM_KEYPOINTS; i++) {
+    const pose_keypoint& pt = pose.pt_[i];
+    pose_keypoint& tracked = track.pose_.pt_[i];
+    tracked.score_ = pt.score_;
+    if (pt.score_ < KEYPOINT_SCORE_MIN) {
+      // keep the last position, the keypoint is hidden
+      continue;
+    }
+    tracked.x_ = track.x_[i].filter(pt.x_, dt, FILTER_MIN_CUTOFF, FILTER_BETA, FILTER_D_CUTOFF);
+    tracked.y_ = track.y_[i].filter(pt.y_, dt, FILTER_MIN_CUTOFF, FILTER_BETA, FILTER_D_CUTOFF);
+  }
+  track.time_ = t;
+  track.missed_ = 0;
+}
+
+void
+pose_tracker_t::update(
+  const pose_results& poses,
+  double t)
+{
+  // greedy matching, closest pairs first
+  struct match_t {
+    float distance_;
+    int track_;
+    int pose_;
+  };
+  std::vector<match_t> matches;
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    float max_distance = std::max(MATCH_DISTANCE_MIN, MATCH_DISTANCE_RATIO * size(tracks_[i].pose_));
+    for (int j = 0; j < poses.n_pose_; j++) {
+      float d = distance(tracks_[i].pose_, poses.pose_[j]);
+      if (d < max_distance) {
+        matches.push_back({d, (int)i, j});
+      }
+    }
+  }
+  std::sort(matches.begin(), matches.end(),
+    [](const match_t& a, const match_t& b) { return a.distance_ < b.distance_; });
+
+  std::vector<bool> track_matched(tracks_.size(), false);
+  bool pose_matched[POSE_NUM_POSE_MAX] = {false};
+  for (size_t i = 0; i < matches.size(); i++) {
+    const match_t& m = matches[i];
+    if (track_matched[m.track_] || pose_matched[m.pose_]) {
+      continue;
+    }
+    filter(tracks_[m.track_], poses.pose_[m.pose_], t);
+    track_matched[m.track_] = true;
+    pose_matched[m.pose_] = true;
+  }
+
+  // age out the unmatched tracks
+  std::vector<track_t> tracks;
+  tracks.reserve(POSE_NUM_POSE_MAX);
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    if (!track_matched[i] && (++tracks_[i].missed_ > TRACK_MISSED_MAX)) {
+      continue;
+    }
+    tracks.push_back(tracks_[i]);
+  }
+
+  // new tracks for the unmatched poses
+  for (int j = 0; (j < poses.n_pose_) && (tracks.size() < POSE_NUM_POSE_MAX); j++) {
+    if (pose_matched[j]) {
+      continue;
+    }
+    tracks.emplace_back();
+    track_t& track = tracks.back();
+    track.pose_ = poses.pose_[j];
+    track.time_ = t;
+    filter(track, poses.pose_[j], t);
+  }
+
+  tracks_.swap(tracks);
+  GST_LOG("%d poses, %zu tracks", poses.n_pose_, tracks_.size());
+}
+
+void
+pose_tracker_t::predict(
+  double t,
+  pose_results& poses) const
+{
+  poses.n_pose_ = 0;
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    const track_t& track = tracks_[i];
+    // hidden on the updates it missed
+    if (track.missed_) {
+      continue;
+    }
+    float dt = (float)std::min(std::max(t - track.time_, 0.0), PREDICT_HORIZON_MAX);
+    pose_structure& pose = poses.pose_[poses.n_pose_++];
+    pose = track.pose_;
+    for (int j = 0; j < POSE_NUM_KEYPOINTS; j++) {
+      if (pose.pt_[j].score_ < KEYPOINT_SCORE_MIN) {
+        continue;
+      }
+      pose.pt_[j].x_ += track.x_[j].velocity() * dt;
+      pose.pt_[j].y_ += track.y_[j].velocity() * dt;
+    }
+  }
+}
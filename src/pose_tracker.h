@@ -0,0 +1,106 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef pose_tracker_h
+#define pose_tracker_h
+
+#include "posenet.h"
+
+// One Euro filter, adaptive low pass for one coordinate.
+// Strong smoothing while still, less lag when moving fast.
+class one_euro_filter_t
+{
+public:
+
+  void reset(void) { initialized_ = false; }
+
+  float filter(
+    float x,
+    float dt,        // seconds
+    float min_cutoff, // Hz
+    float beta,
+    float d_cutoff); // Hz
+
+  float value(void) const { return x_; }
+  // filtered derivative, per second
+  float velocity(void) const { return dx_; }
+
+private:
+
+  bool initialized_ = false;
+  float x_ = 0;
+  float dx_ = 0;
+};
+
+// Pose tracking across inferences.
+// Poses are matched to tracks by keypoint distance, each keypoint is One
+// Euro filtered, and predict() extrapolates the tracks on the frames in
+// between, so PoseNet can run at a fraction of the frame rate without jitter.
+class pose_tracker_t
+{
+public:
+
+  pose_tracker_t();
+  virtual ~pose_tracker_t();
+
+  void reset(void);
+
+  // new poses of the frame at time t (seconds, stream time), in model
+  // coordinates
+  void update(
+    const pose_results& poses,
+    double t);
+
+  // tracked poses extrapolated to the frame at time t
+  void predict(
+    double t,
+    pose_results& poses) const;
+
+private:
+
+  struct track_t {
+    pose_structure pose_;
+    one_euro_filter_t x_[POSE_NUM_KEYPOINTS];
+    one_euro_filter_t y_[POSE_NUM_KEYPOINTS];
+    double time_;
+    int missed_;
+  };
+
+  static float distance(
+    const pose_structure& a,
+    const pose_structure& b);
+
+  static float size(
+    const pose_structure& pose);
+
+  void filter(
+    track_t& track,
+    const pose_structure& pose,
+    double t);
+
+  std::vector<track_t> tracks_;
+
+  // unused
+  pose_tracker_t(const pose_tracker_t&);
+  pose_tracker_t& operator=(const pose_tracker_t&);
+
+};
+
+#endif
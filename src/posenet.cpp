@@ -23,6 +23,7 @@
 #endif
 
 #include "posenet.h"
+#include "pose_tracker.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc/imgproc_c.h>
@@ -30,7 +31,6 @@
 GST_DEBUG_CATEGORY(posenet_t_debug);
 #define GST_CAT_DEFAULT posenet_t_debug
 
-
 static
 const char *keypoint_name[POSE_NUM_KEYPOINTS] =
 {
@@ -54,48 +54,58 @@ const char *keypoint_name[POSE_NUM_KEYPOINTS] =
 };
 
 void posenet_t::parse_pose(
-  pose_results& results,
-  int image_width,
-  int image_height,
-  int wanted_width,
-  int wanted_height)
+  pose_results& results)
 {
-  size_t sz[4] = {0, };
-  float *keypoint_coord = (float *)(typed_output_tensor<float>(0, &sz[0]));
-  float *keypoint_score = (float *)(typed_output_tensor<float>(1, &sz[1]));
-  float *pose_score = (float *)(typed_output_tensor<float>(2, &sz[2]));
-  float *npose_f = (float *)(typed_output_tensor<float>(3, &sz[3]));
-
-  GST_TRACE("posenet: %p[%ld], %p[%ld], %p[%ld], %p[%ld]",
-        keypoint_coord, sz[0],
-        keypoint_score, sz[1],
-        pose_score, sz[2],
-        npose_f, sz[3]);
-
-  results.n_pose_ = (int)(*npose_f);
+  const output_tensor_t& keypoint_coord = outputs_[OUTPUT_KEYPOINT_COORD];
+  const output_tensor_t& keypoint_score = outputs_[OUTPUT_KEYPOINT_SCORE];
+  const output_tensor_t& pose_score = outputs_[OUTPUT_POSE_SCORE];
+  const output_tensor_t& npose = outputs_[OUTPUT_NUM_POSE];
+
+  results.n_pose_ = 0;
+  if (!npose.bound()) {
+    return;
+  }
+
+  GST_TRACE("posenet: [%zu], [%zu], [%zu], [%zu]",
+        keypoint_coord.length(), keypoint_score.length(),
+        pose_score.length(), npose.length());
+
+  // dequantize the valid poses only, in bulk
+  int n_pose = std::min((int)npose.get(0), POSE_NUM_POSE_MAX);
+  n_pose = std::min(n_pose, (int)pose_score.length());
+  n_pose = std::min(n_pose, (int)(keypoint_score.length() / POSE_NUM_KEYPOINTS));
+  n_pose = std::min(n_pose, (int)(keypoint_coord.length() / (2 * POSE_NUM_KEYPOINTS)));
+  n_pose = std::max(n_pose, 0);
+  float coord[POSE_NUM_POSE_MAX * POSE_NUM_KEYPOINTS * 2];
+  float score[POSE_NUM_POSE_MAX * POSE_NUM_KEYPOINTS];
+  keypoint_coord.get(0, n_pose * POSE_NUM_KEYPOINTS * 2, coord);
+  keypoint_score.get(0, n_pose * POSE_NUM_KEYPOINTS, score);
+
+  results.n_pose_ = n_pose;
+  const float *pcoord = coord;
+  const float *pscore = score;
   for (int i = 0; i < results.n_pose_; i++) {
-    results.pose_[i].score_ = pose_score[i];
+    results.pose_[i].score_ = pose_score.get(i);
     for (int j = 0; j < POSE_NUM_KEYPOINTS; j++) {
-      results.pose_[i].pt_[j].y_ = *keypoint_coord++ * image_height / wanted_height;
-      results.pose_[i].pt_[j].x_ = *keypoint_coord++ * image_width / wanted_width;
-      results.pose_[i].pt_[j].score_ = *keypoint_score++;
+      results.pose_[i].pt_[j].y_ = *pcoord++;
+      results.pose_[i].pt_[j].x_ = *pcoord++;
+      results.pose_[i].pt_[j].score_ = *pscore++;
     }
   }
 }
 
 void posenet_t::draw_keypoint(
-  cv::Mat& frame,
+  canvas_t& canvas,
   pose_keypoint& point)
 {
   cv::Point pt;
   pt.x = point.x_;
   pt.y = point.y_;
-  //cv::circle(frame, pt, 4, cv::Scalar(255, 255, 0), 2, cv::LINE_AA);
-  cv::circle(frame, pt, 4, cv::Scalar(255, 255, 0), 2);
+  canvas.circle(pt, 4, cv::Scalar(255, 255, 0), 2);
 }
 
 void posenet_t::draw_body_line(
-  cv::Mat& frame,
+  canvas_t& canvas,
   pose_keypoint& start,
   pose_keypoint& end)
 {
@@ -105,12 +115,11 @@ void posenet_t::draw_body_line(
   cv::Point pt_end;
   pt_end.x = end.x_;
   pt_end.y = end.y_;
-  //cv::line(frame, pt_start, pt_end, cv::Scalar(255, 255, 0), 2, cv::LINE_AA);
-  cv::line(frame, pt_start, pt_end, cv::Scalar(255, 255, 0), 2);
+  canvas.line(pt_start, pt_end, cv::Scalar(255, 255, 0), 2);
 }
 
 void posenet_t::draw_pose(
-  cv::Mat& frame,
+  canvas_t& canvas,
   pose_results& results,
   float pose_threshold,
   float keypoint_threshold)
@@ -119,7 +128,7 @@ void posenet_t::draw_pose(
     if (results.pose_[n].score_ > pose_threshold) {
       for (int i = 0; i < POSE_NUM_KEYPOINTS; i++) {
         if (results.pose_[n].pt_[i].score_ > keypoint_threshold) {
-          draw_keypoint(frame, results.pose_[n].pt_[i]);
+          draw_keypoint(canvas, results.pose_[n].pt_[i]);
         }
       }
       struct Line {
@@ -142,7 +151,7 @@ void posenet_t::draw_pose(
       for (int i = 0; i < sizeof(lines)/sizeof(struct Line); i++) {
         if ((results.pose_[n].pt_[lines[i].start].score_ > keypoint_threshold) &&
           (results.pose_[n].pt_[lines[i].end].score_ > keypoint_threshold)) {
-          draw_body_line(frame, results.pose_[n].pt_[lines[i].start], results.pose_[n].pt_[lines[i].end]);
+          draw_body_line(canvas, results.pose_[n].pt_[lines[i].start], results.pose_[n].pt_[lines[i].end]);
         }
       }
     }
@@ -154,6 +163,7 @@ posenet_t::posenet_t()
 {
   GST_DEBUG_CATEGORY_INIT(posenet_t_debug, "posenet_t", 0, "i.MX NN Inference demo TFLite posenet class");
   GST_TRACE("%s", __func__);
+  tracker_.reset(new pose_tracker_t());
 }
 
 posenet_t::~posenet_t()
@@ -167,18 +177,79 @@ int posenet_t::init(
   int num_threads)
 {
   GST_TRACE("%s", __func__);
-  return tflite_inference_t::init(model, use_nnapi, num_threads);
+  int ret = tflite_inference_t::init(model, use_nnapi, num_threads);
+  if (ret != OK) {
+    return ret;
+  }
+
+  static const char *output_name[OUTPUT_COUNT] = {
+    "poses",
+    "poses:1",
+    "poses:2",
+    "poses:3",
+  };
+  for (int i = 0; i < OUTPUT_COUNT; i++) {
+    if (bind_output(output_name[i], i, outputs_[i]) != OK) {
+      return ERROR;
+    }
+  }
+  return OK;
 }
 
-int posenet_t::draw_results(cv::Mat& frame)
+int posenet_t::parse_results(void)
 {
   GST_TRACE("%s", __func__);
 
   pose_results results;
-  parse_pose(results, frame.cols, frame.rows, bgrx_width_, bgrx_height_);
+  parse_pose(results);
+
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  results_ = results;
+  if (tracking_) {
+    tracker_->update(results_, input_time_);
+  }
+  return OK;
+}
+
+void posenet_t::set_tracking(bool enable)
+{
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  tracking_ = enable;
+  tracker_->reset();
+}
+
+void posenet_t::get_results(pose_results& results)
+{
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  results = results_;
+}
+
+int posenet_t::draw_results(canvas_t& canvas)
+{
+  GST_TRACE("%s", __func__);
+
+  pose_results results;
+  {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    if (tracking_) {
+      tracker_->predict(draw_time_, results);
+    } else {
+      results = results_;
+    }
+  }
+
+  // scale up to src image size
+  float scale_x = (float)canvas.width() / bgrx_width_;
+  float scale_y = (float)canvas.height() / bgrx_height_;
+  for (int i = 0; i < results.n_pose_; i++) {
+    for (int j = 0; j < POSE_NUM_KEYPOINTS; j++) {
+      results.pose_[i].pt_[j].x_ *= scale_x;
+      results.pose_[i].pt_[j].y_ *= scale_y;
+    }
+  }
   float pose_threshold = 0.3;
   float keypoint_threshold = 0.3;
-  draw_pose(frame, results, pose_threshold, keypoint_threshold);
+  draw_pose(canvas, results, pose_threshold, keypoint_threshold);
 
   return OK;
 }
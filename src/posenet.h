@@ -22,6 +22,7 @@
 #define posenet_h
 
 #include "tflite_inference.h"
+#include <memory>
 
 #define POSE_NUM_KEYPOINTS (17)
 #define POSE_NUM_POSE_MAX (10)
@@ -42,6 +43,8 @@ struct pose_results {
   pose_structure pose_[POSE_NUM_POSE_MAX];
 };
 
+class pose_tracker_t;
+
 class posenet_t : public tflite_inference_t
 {
 public:
@@ -60,31 +63,52 @@ public:
     int use_nnapi = 2,
     int num_threads = 4);
 
-  virtual int draw_results(cv::Mat& frame);
+  virtual int parse_results(void);
+  virtual int draw_results(canvas_t& canvas);
+
+  // last parsed poses, in model input coordinates
+  void get_results(pose_results& results);
+
+  // smooth the poses across inferences and extrapolate them on the frames
+  // in between, on by default
+  void set_tracking(bool enable);
+
+  // poses in canvas coordinates
+  void draw_pose(
+    canvas_t& canvas,
+    pose_results& results,
+    float pose_threshold,
+    float keypoint_threshold);
 
 private:
 
+  // keypoints in model input coordinates
   void parse_pose(
-    pose_results& results,
-    int image_width,
-    int image_height,
-    int wanted_width,
-    int wanted_height);
+    pose_results& results);
 
   void draw_keypoint(
-    cv::Mat& frame,
+    canvas_t& canvas,
     pose_keypoint& point);
 
   void draw_body_line(
-    cv::Mat& frame,
+    canvas_t& canvas,
     pose_keypoint& start,
     pose_keypoint& end);
 
-  void draw_pose(
-    cv::Mat& frame,
-    pose_results& results,
-    float pose_threshold,
-    float keypoint_threshold);
+  // PosenetDecoderOp outputs
+  enum {
+    OUTPUT_KEYPOINT_COORD,
+    OUTPUT_KEYPOINT_SCORE,
+    OUTPUT_POSE_SCORE,
+    OUTPUT_NUM_POSE,
+    OUTPUT_COUNT,
+  };
+  output_tensor_t outputs_[OUTPUT_COUNT];
+
+  // guarded by results_mutex_
+  pose_results results_ = {0};
+  std::unique_ptr<pose_tracker_t> tracker_;
+  bool tracking_ = true;
 
   // unused
   posenet_t(const posenet_t&);
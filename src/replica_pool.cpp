@@ -0,0 +1,124 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "replica_pool.h"
+#include <gst/gst.h>
+#include <algorithm>
+
+GST_DEBUG_CATEGORY(replica_pool_t_debug);
+#define GST_CAT_DEFAULT replica_pool_t_debug
+
+// weight of the last run in the smoothed latency
+#define LATENCY_SMOOTHING (0.2)
+
+
+replica_pool_t::replica_pool_t(inference_t *primary)
+{
+  GST_DEBUG_CATEGORY_INIT(replica_pool_t_debug, "replica_pool_t", 0, "i.MX NN Inference demo model replica pool class");
+  GST_TRACE("%s", __func__);
+
+  add_worker(primary);
+}
+
+replica_pool_t::~replica_pool_t()
+{
+  GST_TRACE("%s", __func__);
+
+  // workers first, they run the replicas
+  for (size_t i = 0; i < workers_.size(); i++) {
+    delete workers_[i];
+  }
+  for (size_t i = 1; i < replicas_.size(); i++) {
+    delete replicas_[i];
+  }
+}
+
+void
+replica_pool_t::add(
+  inference_t *replica)
+{
+  add_worker(replica);
+  GST_DEBUG("%zu replicas", replicas_.size());
+}
+
+void
+replica_pool_t::add_worker(
+  inference_t *replica)
+{
+  replicas_.push_back(replica);
+  workers_.push_back(new inference_worker_t(replica));
+  latency_.push_back(0);
+  submit_time_.push_back(std::chrono::steady_clock::now());
+  pending_.push_back(false);
+}
+
+void
+replica_pool_t::wait_all(void)
+{
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->wait();
+  }
+}
+
+int
+replica_pool_t::submit(
+  size_t i)
+{
+  // the previous run is done, the worker refuses the request otherwise
+  if (pending_[i] && !workers_[i]->busy()) {
+    double latency = workers_[i]->get_latency();
+    latency_[i] = (latency_[i] == 0) ? latency :
+        LATENCY_SMOOTHING * latency + (1.0 - LATENCY_SMOOTHING) * latency_[i];
+    pending_[i] = false;
+  }
+
+  if (workers_[i]->submit() != OK) {
+    return ERROR;
+  }
+  submit_time_[i] = std::chrono::steady_clock::now();
+  pending_[i] = true;
+  return OK;
+}
+
+size_t
+replica_pool_t::earliest(void)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  size_t best = 0;
+  double best_finish = 0;
+
+  for (size_t i = 0; i < workers_.size(); i++) {
+    // ms from now: what is left of the run in flight, then a whole run
+    double finish = latency_[i];
+    if (workers_[i]->busy()) {
+      std::chrono::duration<double, std::milli> elapsed = now - submit_time_[i];
+      finish += std::max(0.0, latency_[i] - elapsed.count());
+    }
+    if ((i == 0) || (finish < best_finish)) {
+      best = i;
+      best_finish = finish;
+    }
+  }
+  return best;
+}
@@ -0,0 +1,84 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef replica_pool_h
+#define replica_pool_h
+
+#include <chrono>
+#include <vector>
+#include "inference.h"
+#include "inference_worker.h"
+
+// Replicas of a model, each run by its own inference_worker_t, so several
+// frames are inferred at once, and frames may complete out of order.
+// Replicas may run on different backends, the pool keeps a smoothed latency
+// of each so frames can be sent to the one that will finish first.
+class replica_pool_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  // the primary replica stays owned by the caller
+  explicit replica_pool_t(inference_t *primary);
+  virtual ~replica_pool_t();
+
+  // takes ownership
+  void add(inference_t *replica);
+
+  size_t size(void) const { return replicas_.size(); }
+  inference_t* get(size_t i) { return replicas_[i]; }
+  inference_worker_t* worker(size_t i) { return workers_[i]; }
+
+  // blocks until no replica is running
+  void wait_all(void);
+
+  // start replica i on its input tensor, loaded by the caller
+  int submit(size_t i);
+
+  // replica that would finish a frame submitted now first, from the smoothed
+  // latencies and the runs in flight. It may be busy, replicas without a
+  // latency yet are tried first
+  size_t earliest(void);
+
+  // smoothed latency of replica i, in ms, 0 until its first run is done
+  double get_latency(size_t i) const { return latency_[i]; }
+
+private:
+
+  void add_worker(inference_t *replica);
+
+  std::vector<inference_t*> replicas_;
+  std::vector<inference_worker_t*> workers_;
+  std::vector<double> latency_;
+  std::vector<std::chrono::steady_clock::time_point> submit_time_;
+  // a run of the replica was submitted, its latency not folded in yet
+  std::vector<bool> pending_;
+
+  // unused
+  replica_pool_t(const replica_pool_t&);
+  replica_pool_t& operator=(const replica_pool_t&);
+
+};
+
+#endif
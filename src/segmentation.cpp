@@ -0,0 +1,187 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "segmentation.h"
+#include "utils.h"
+#include <algorithm>
+#include <string.h>
+
+GST_DEBUG_CATEGORY(segmentation_t_debug);
+#define GST_CAT_DEFAULT segmentation_t_debug
+
+// mask rows per worker pool slice, at least
+#define MASK_ROWS_GRAIN (8)
+
+
+segmentation_t::segmentation_t()
+{
+  GST_DEBUG_CATEGORY_INIT(segmentation_t_debug, "segmentation_t", 0, "i.MX NN Inference demo TFLite segmentation class");
+  GST_TRACE("%s", __func__);
+  build_palette();
+}
+
+segmentation_t::~segmentation_t()
+{
+  GST_TRACE("%s", __func__);
+}
+
+int segmentation_t::init(
+  const std::string& model,
+  int use_nnapi,
+  int num_threads)
+{
+  GST_TRACE("%s", __func__);
+  int ret = tflite_inference_t::init(model, use_nnapi, num_threads);
+  if (ret != OK) {
+    return ret;
+  }
+
+  const TfLiteTensor *tensor = interpreter_->tensor(interpreter_->outputs()[0]);
+  if ((tensor->type != kTfLiteUInt8) && (tensor->type != kTfLiteInt8) && (tensor->type != kTfLiteFloat32)) {
+    GST_ERROR("Unsupported output tensor type %d", tensor->type);
+    return ERROR;
+  }
+  if (tensor->dims->size != 4) {
+    GST_ERROR("Expected a [1, height, width, classes] output, got %d dims", tensor->dims->size);
+    return ERROR;
+  }
+  mask_height_ = tensor->dims->data[1];
+  mask_width_ = tensor->dims->data[2];
+  num_classes_ = tensor->dims->data[3];
+  if ((num_classes_ < 1) || (num_classes_ > NUM_CLASSES_MAX)) {
+    GST_ERROR("Unsupported number of classes %d", num_classes_);
+    return ERROR;
+  }
+
+  GST_DEBUG("mask %dx%d, %d classes", mask_width_, mask_height_, num_classes_);
+  return OK;
+}
+
+void
+segmentation_t::build_palette(void)
+{
+  // PASCAL VOC colormap
+  uint32_t alpha = (uint32_t)(opacity_ * 255 + 0.5f);
+  palette_[0] = 0;
+  for (int i = 1; i < NUM_CLASSES_MAX; i++) {
+    uint32_t r = 0, g = 0, b = 0;
+    int c = i;
+    for (int j = 7; j >= 0; j--) {
+      r |= ((c >> 0) & 1) << j;
+      g |= ((c >> 1) & 1) << j;
+      b |= ((c >> 2) & 1) << j;
+      c >>= 3;
+    }
+    r = (r * alpha + 127) / 255;
+    g = (g * alpha + 127) / 255;
+    b = (b * alpha + 127) / 255;
+    // B, G, R, A in memory
+    palette_[i] = b | (g << 8) | (r << 16) | (alpha << 24);
+  }
+}
+
+void
+segmentation_t::set_opacity(
+  float opacity)
+{
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  opacity_ = std::min(std::max(opacity, 0.0f), 1.0f);
+  build_palette();
+}
+
+int segmentation_t::parse_results(void)
+{
+  GST_TRACE("%s", __func__);
+
+  const TfLiteTensor *tensor = interpreter_->tensor(interpreter_->outputs()[0]);
+  int num_pixels = mask_width_ * mask_height_;
+  parsed_.resize(num_pixels);
+
+  // quantization is monotonic, argmax on the raw values, by bands of rows
+  if ((tensor->type != kTfLiteUInt8) && (tensor->type != kTfLiteInt8) && (tensor->type != kTfLiteFloat32)) {
+    return ERROR;
+  }
+  uint8_t *parsed = parsed_.data();
+  parallel_for(mask_height_, MASK_ROWS_GRAIN, [&](int first, int last) {
+    size_t offset = (size_t)first * mask_width_;
+    int n = (last - first) * mask_width_;
+    switch (tensor->type) {
+    case kTfLiteUInt8:
+      utils::argmax_u8(tensor->data.uint8 + offset * num_classes_, n, num_classes_, parsed + offset);
+      break;
+    case kTfLiteInt8:
+      utils::argmax_s8(tensor->data.int8 + offset * num_classes_, n, num_classes_, parsed + offset);
+      break;
+    default:
+      utils::argmax_f32(tensor->data.f + offset * num_classes_, n, num_classes_, parsed + offset);
+      break;
+    }
+  });
+
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  classes_.swap(parsed_);
+  return OK;
+}
+
+int segmentation_t::draw_results(canvas_t& canvas)
+{
+  // the mask is blended by the 2D device, see draw_mask()
+  return OK;
+}
+
+bool
+segmentation_t::get_mask_size(
+  int *width,
+  int *height)
+{
+  *width = mask_width_;
+  *height = mask_height_;
+  return (mask_width_ > 0) && (mask_height_ > 0);
+}
+
+int
+segmentation_t::draw_mask(
+  uint8_t *bgra,
+  int stride)
+{
+  std::lock_guard<std::mutex> lock(results_mutex_);
+  if (classes_.empty()) {
+    for (int y = 0; y < mask_height_; y++) {
+      memset(bgra + y * stride, 0, mask_width_ * 4);
+    }
+    return OK;
+  }
+
+  parallel_for(mask_height_, MASK_ROWS_GRAIN, [&](int first, int last) {
+    const uint8_t *classes = classes_.data() + (size_t)first * mask_width_;
+    for (int y = first; y < last; y++) {
+      uint32_t *row = (uint32_t *)(bgra + y * stride);
+      for (int x = 0; x < mask_width_; x++) {
+        row[x] = palette_[classes[x]];
+      }
+      classes += mask_width_;
+    }
+  });
+  return OK;
+}
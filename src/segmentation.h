@@ -0,0 +1,80 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef segmentation_h
+#define segmentation_h
+
+#include "tflite_inference.h"
+#include <vector>
+
+// semantic segmentation (DeepLab style), single [1, height, width, classes]
+// output tensor (uint8, int8 or float32)
+class segmentation_t : public tflite_inference_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  static const int NUM_CLASSES_MAX = 256;
+
+  segmentation_t();
+  virtual ~segmentation_t();
+
+  int init(
+    const std::string& model,
+    int use_nnapi = 2,
+    int num_threads = 4);
+
+  // mask opacity, 0.0 .. 1.0
+  void set_opacity(float opacity);
+
+  virtual int parse_results(void);
+  virtual int draw_results(canvas_t& canvas);
+
+  virtual bool get_mask_size(int *width, int *height);
+  virtual int draw_mask(uint8_t *bgra, int stride);
+
+private:
+
+  void build_palette(void);
+
+  int mask_width_ = 0;
+  int mask_height_ = 0;
+  int num_classes_ = 0;
+  float opacity_ = 0.5f;
+
+  // premultiplied BGRA per class, class 0 (background) is transparent
+  uint32_t palette_[NUM_CLASSES_MAX];
+
+  // last class map, guarded by results_mutex_
+  std::vector<uint8_t> classes_;
+  // parse_results scratch, swapped with classes_
+  std::vector<uint8_t> parsed_;
+
+  // unused
+  segmentation_t(const segmentation_t&);
+  segmentation_t& operator=(const segmentation_t&);
+
+};
+
+#endif
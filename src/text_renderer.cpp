@@ -0,0 +1,177 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "text_renderer.h"
+#include <gst/gst.h>
+
+GST_DEBUG_CATEGORY(text_renderer_t_debug);
+#define GST_CAT_DEFAULT text_renderer_t_debug
+
+
+text_renderer_t::text_renderer_t()
+{
+  GST_DEBUG_CATEGORY_INIT(text_renderer_t_debug, "text_renderer_t", 0, "i.MX NN Inference demo text renderer class");
+  GST_TRACE("%s", __func__);
+}
+
+text_renderer_t::~text_renderer_t()
+{
+  GST_TRACE("%s", __func__);
+}
+
+int text_renderer_t::init(
+  int font_face,
+  double font_scale,
+  int thickness)
+{
+  GST_TRACE("%s", __func__);
+
+  if (!atlas_.empty() &&
+      (font_face == font_face_) &&
+      (font_scale == font_scale_) &&
+      (thickness == thickness_)) {
+    return OK;
+  }
+
+  font_face_ = font_face;
+  font_scale_ = font_scale;
+  thickness_ = thickness;
+
+  // Hershey fonts share height and baseline for all glyphs
+  baseline_ = 0;
+  height_ = cv::getTextSize("A", font_face_, font_scale_, thickness_, &baseline_).height;
+  // room for thick and anti-aliased strokes around the glyph box
+  pad_ = thickness_ + 1;
+
+  int cell_height = height_ + baseline_ + 2 * pad_;
+  int atlas_width = 0;
+  int width[NUM_GLYPHS];
+  for (int i = 0; i < NUM_GLYPHS; i++) {
+    int baseline = 0;
+    std::string str(1, (char)(FIRST_GLYPH + i));
+    width[i] = cv::getTextSize(str, font_face_, font_scale_, thickness_, &baseline).width;
+    atlas_width += width[i] + 3 * pad_;
+  }
+
+  atlas_ = cv::Mat::zeros(cell_height, atlas_width, CV_8UC1);
+  int x = 0;
+  for (int i = 0; i < NUM_GLYPHS; i++) {
+    std::string str(1, (char)(FIRST_GLYPH + i));
+    glyph_t& glyph = glyphs_[i];
+    glyph.advance_ = std::max(0, width[i] - thickness_);
+    glyph.rect_ = cv::Rect(x, 0, width[i] + 2 * pad_, cell_height);
+    // rasterized only once, so anti-aliasing is free
+    cv::putText(atlas_, str, cv::Point(x + pad_, pad_ + height_), font_face_, font_scale_, cv::Scalar(255), thickness_, cv::LINE_AA);
+    // keep a gap of pad_ between cells
+    x += glyph.rect_.width + pad_;
+  }
+
+  GST_DEBUG("glyph atlas: %dx%d, height: %d, baseline: %d", atlas_.cols, atlas_.rows, height_, baseline_);
+  return OK;
+}
+
+const text_renderer_t::glyph_t*
+text_renderer_t::get_glyph(char c) const
+{
+  if ((c < FIRST_GLYPH) || (c > LAST_GLYPH)) {
+    c = '?';
+  }
+  return &glyphs_[c - FIRST_GLYPH];
+}
+
+cv::Size
+text_renderer_t::get_text_size(
+  const std::string& str,
+  int *baseline) const
+{
+  int width = 0;
+  for (size_t i = 0; i < str.length(); i++) {
+    width += get_glyph(str[i])->advance_;
+  }
+  if (baseline) {
+    *baseline = baseline_;
+  }
+  return cv::Size(width + thickness_, height_);
+}
+
+void
+text_renderer_t::draw(
+  canvas_t& canvas,
+  const std::string& str,
+  cv::Point org,
+  const cv::Scalar& color) const
+{
+  int x = org.x;
+  int y = org.y - height_ - pad_;
+  for (size_t i = 0; i < str.length(); i++) {
+    const glyph_t *glyph = get_glyph(str[i]);
+    if (str[i] != ' ') {
+      canvas.blend_mask(atlas_(glyph->rect_), cv::Point(x - pad_, y), color);
+    }
+    x += glyph->advance_;
+  }
+}
+
+void
+text_renderer_t::update(
+  cached_text_t& cache,
+  const std::string& str) const
+{
+  if (!cache.mask_.empty() && (cache.str_ == str)) {
+    return;
+  }
+
+  cache.str_ = str;
+  cache.size_ = get_text_size(str, &cache.baseline_);
+
+  // mask origin is (-pad_, -pad_) from the top-left corner of the text box
+  int width = 0;
+  int x = 0;
+  for (size_t i = 0; i < str.length(); i++) {
+    const glyph_t *glyph = get_glyph(str[i]);
+    width = std::max(width, x + glyph->rect_.width);
+    x += glyph->advance_;
+  }
+  cache.mask_ = cv::Mat::zeros(height_ + baseline_ + 2 * pad_, std::max(width, 1), CV_8UC1);
+
+  x = 0;
+  for (size_t i = 0; i < str.length(); i++) {
+    const glyph_t *glyph = get_glyph(str[i]);
+    cv::Mat cell = cache.mask_(cv::Rect(x, 0, glyph->rect_.width, glyph->rect_.height));
+    cv::max(cell, atlas_(glyph->rect_), cell);
+    x += glyph->advance_;
+  }
+}
+
+void
+text_renderer_t::draw(
+  canvas_t& canvas,
+  cached_text_t& cache,
+  const std::string& str,
+  cv::Point org,
+  const cv::Scalar& color) const
+{
+  update(cache, str);
+  canvas.blend_mask(cache.mask_, cv::Point(org.x - pad_, org.y - height_ - pad_), color);
+}
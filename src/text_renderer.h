@@ -0,0 +1,111 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef text_renderer_h
+#define text_renderer_h
+
+#include <string>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "canvas.h"
+
+// Text renderer.
+// Printable ASCII glyphs are rasterized once into an 8bit alpha atlas with
+// OpenCV Hershey fonts, then strings are drawn by alpha blending atlas
+// cells into the canvas.
+class text_renderer_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  // a string rendered once into an alpha mask, redrawn as is until it changes
+  struct cached_text_t {
+    std::string str_;
+    cv::Mat mask_;
+    cv::Size size_;
+    int baseline_ = 0;
+  };
+
+  text_renderer_t();
+  virtual ~text_renderer_t();
+
+  // (re)build the glyph atlas, does nothing if the font is unchanged
+  int init(
+    int font_face,
+    double font_scale,
+    int thickness);
+
+  // same metrics as cv::getTextSize()
+  cv::Size get_text_size(
+    const std::string& str,
+    int *baseline) const;
+
+  // org is the bottom-left corner of the text, as for cv::putText()
+  void draw(
+    canvas_t& canvas,
+    const std::string& str,
+    cv::Point org,
+    const cv::Scalar& color) const;
+
+  void draw(
+    canvas_t& canvas,
+    cached_text_t& cache,
+    const std::string& str,
+    cv::Point org,
+    const cv::Scalar& color) const;
+
+  void update(
+    cached_text_t& cache,
+    const std::string& str) const;
+
+private:
+
+  static const int FIRST_GLYPH = 0x20;
+  static const int LAST_GLYPH = 0x7e;
+  static const int NUM_GLYPHS = LAST_GLYPH - FIRST_GLYPH + 1;
+
+  struct glyph_t {
+    int advance_;
+    cv::Rect rect_;   // cell in atlas_
+  };
+
+  const glyph_t* get_glyph(char c) const;
+
+  cv::Mat atlas_;
+  glyph_t glyphs_[NUM_GLYPHS];
+  int font_face_ = -1;
+  double font_scale_ = 0;
+  int thickness_ = 0;
+  // metrics shared by all glyphs
+  int height_ = 0;
+  int baseline_ = 0;
+  int pad_ = 0;
+
+  // unused
+  text_renderer_t(const text_renderer_t&);
+  text_renderer_t& operator=(const text_renderer_t&);
+
+};
+
+#endif
@@ -48,7 +48,7 @@ int tflite_benchmark_t::init(
   return tflite_inference_t::init(model, use_nnapi, num_threads);
 }
 
-int tflite_benchmark_t::draw_results(cv::Mat& frame)
+int tflite_benchmark_t::draw_results(canvas_t& canvas)
 {
   GST_TRACE("%s", __func__);
   return OK;
@@ -41,7 +41,7 @@ public:
     int use_nnapi = 2,
     int num_threads = 4);
 
-  int draw_results(cv::Mat& frame);
+  int draw_results(canvas_t& canvas);
 
 private:
 
@@ -34,15 +34,28 @@
 #include <tensorflow/lite/optional_debug_tools.h>
 #include <tensorflow/lite/delegates/nnapi/nnapi_delegate.h>
 #include <tensorflow/lite/delegates/external/external_delegate.h>
+#include <tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h>
 
 // std
+#include <algorithm>
+#include <thread>
+#include <sched.h>
 #include <map>
 #include <fstream>
+#include <cstring>
 
 
 GST_DEBUG_CATEGORY(tflite_inference_t_debug);
 #define GST_CAT_DEFAULT tflite_inference_t_debug
 
+// autotuner: p50 over AUTOTUNE_WINDOW runs, AUTOTUNE_WARMUP runs ignored
+// after each change, a probe every AUTOTUNE_PERIOD runs, switch only when
+// better by AUTOTUNE_HYSTERESIS
+#define AUTOTUNE_WINDOW (30)
+#define AUTOTUNE_WARMUP (3)
+#define AUTOTUNE_PERIOD (300)
+#define AUTOTUNE_HYSTERESIS (0.05)
+
 tflite_inference_t::tflite_inference_t()
 {
   GST_DEBUG_CATEGORY_INIT(tflite_inference_t_debug, "tflite_inference_t", 0, "i.MX NN Inference demo tflite_inference class");
@@ -97,15 +110,30 @@ int tflite_inference_t::init(
   interpreter_->SetNumThreads(1);// num_of_thread is ignored
 #else
   interpreter_->SetNumThreads(num_threads);
+  num_threads_ = num_threads;
+  requested_threads_ = num_threads;
 #endif
 
-  apply_delegate(use_nnapi);
+  if (apply_delegate(use_nnapi) != OK) {
+    return ERROR;
+  }
 
   if (interpreter_->AllocateTensors() != kTfLiteOk) {
     GST_ERROR ("Failed to allocate TFLite tensors!");
     return ERROR;
   }
 
+  tensor_length_.assign(interpreter_->tensors_size(), 0);
+  for (size_t i = 0; i < tensor_length_.size(); i++) {
+    TfLiteIntArray *dims = interpreter_->tensor(i)->dims;
+    if (dims && dims->size && dims->data[0]) {
+      tensor_length_[i] = 1;
+      for (int j = 0; j < dims->size; j++) {
+        tensor_length_[i] *= dims->data[j];
+      }
+    }
+  }
+
   if (verbose_) {
     tflite::PrintInterpreterState(interpreter_.get());
   }
@@ -128,10 +156,15 @@ int tflite_inference_t::init(
   uint8_t* p = 0;
   int ret = get_input_tensor(&p, &sz);
   std::memset(p, 0, sz);
-  if (interpreter_->Invoke() != kTfLiteOk) {
+  // also the warm-up run: delegate graph compilation and lazy allocations
+  // don't land on the first frame. Not counted in the stats nor the autotuner
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (invoke() != kTfLiteOk) {
     GST_ERROR("Failed to invoke TFLite interpreter");
     return ERROR;
   }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  GST_DEBUG("initial inference: %.1f ms", elapsed.count());
 
   return OK;
 }
@@ -159,6 +192,16 @@ int tflite_inference_t::apply_delegate(
     } else {
       delegates.emplace("vx-delegate", std::move(delegate));
     }
+  } else if (use_nnapi == 3) {
+    // CPU, its thread pool is sized once here
+    auto xnnpack_option = TfLiteXNNPackDelegateOptionsDefault();
+    xnnpack_option.num_threads = std::max(1, num_threads_);
+    auto delegate = tflite::Interpreter::TfLiteDelegatePtr(TfLiteXNNPackDelegateCreate(&xnnpack_option), [](TfLiteDelegate*) {});
+    if (!delegate) {
+      GST_WARNING("XNNPACK backend is unsupported on this platform.");
+    } else {
+      delegates.emplace("XNNPACK", std::move(delegate));
+    }
   }
 
   for (const auto& delegate : delegates) {
@@ -182,15 +225,167 @@ int tflite_inference_t::inference(void)
   std::chrono::steady_clock::time_point inference_start = std::chrono::steady_clock::now();
 
   // tflite inference
-  if (interpreter_->Invoke() != kTfLiteOk) {
+  if (invoke() != kTfLiteOk) {
     return ERROR;
   }
 
   std::chrono::steady_clock::time_point inference_end = std::chrono::steady_clock::now();
   std::chrono::duration<double> inference_time = inference_end - inference_start;
-  inference_time_cur_ = std::chrono::duration_cast<std::chrono::nanoseconds>(inference_time).count() / 1000000.0;
+  double inference_ms = std::chrono::duration_cast<std::chrono::nanoseconds>(inference_time).count() / 1000000.0;
+  inference_time_cur_ = inference_ms;
+
+  autotune(inference_ms);
+
+  return OK;
+}
+
+int tflite_inference_t::set_autotune(bool enable)
+{
+  GST_TRACE("%s", __func__);
+
+#ifdef BUILD_WITH_EDGETPU
+  return ERROR;
+#else
+  autotune_enabled_ = enable;
+  return OK;
+#endif
+}
+
+void tflite_inference_t::set_autotune_callback(const autotune_callback_t& callback)
+{
+  GST_TRACE("%s", __func__);
+  autotune_callback_ = callback;
+}
+
+void tflite_inference_t::autotune(double inference_time)
+{
+  if (!autotune_enabled_) {
+    autotune_state_ = AUTOTUNE_MEASURE;
+    autotune_samples_.clear();
+    return;
+  }
+  if (autotune_skip_ > 0) {
+    autotune_skip_--;
+    return;
+  }
+  if ((autotune_state_ == AUTOTUNE_PROBE) && (num_threads_ != autotune_probe_)) {
+    // num-threads set meanwhile, measure from there
+    autotune_state_ = AUTOTUNE_MEASURE;
+    autotune_samples_.clear();
+    autotune_skip_ = AUTOTUNE_WARMUP;
+    return;
+  }
+  if (autotune_state_ == AUTOTUNE_SETTLE) {
+    if (++autotune_count_ >= AUTOTUNE_PERIOD) {
+      autotune_state_ = AUTOTUNE_MEASURE;
+    }
+    return;
+  }
+
+  autotune_samples_.push_back(inference_time);
+  if (autotune_samples_.size() < AUTOTUNE_WINDOW) {
+    return;
+  }
+  std::vector<double>::iterator mid = autotune_samples_.begin() + autotune_samples_.size() / 2;
+  std::nth_element(autotune_samples_.begin(), mid, autotune_samples_.end());
+  double p50 = *mid;
+  autotune_samples_.clear();
+
+  if (autotune_state_ == AUTOTUNE_MEASURE) {
+    // current setting measured again, the load may have changed since
+    autotune_threads_ = num_threads_;
+    autotune_p50_ = p50;
+
+    // the CPUs this thread may run on, cpu-affinity included
+    int max_threads = (int)std::thread::hardware_concurrency();
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+      max_threads = CPU_COUNT(&cpus);
+    }
+    max_threads = std::max(1, max_threads);
+    int probe = num_threads_ + autotune_direction_;
+    if ((probe < 1) || (probe > max_threads)) {
+      autotune_direction_ = -autotune_direction_;
+      probe = num_threads_ + autotune_direction_;
+    }
+    if ((probe < 1) || (probe > max_threads)) {
+      autotune_state_ = AUTOTUNE_SETTLE;
+      autotune_count_ = 0;
+      return;
+    }
+    GST_DEBUG("autotune: %d threads p50 %.2f ms, probing %d", num_threads_, p50, probe);
+    autotune_probe_ = probe;
+    requested_threads_ = probe;
+    autotune_skip_ = AUTOTUNE_WARMUP;
+    autotune_state_ = AUTOTUNE_PROBE;
+    return;
+  }
+
+  // AUTOTUNE_PROBE
+  autotune_decision_t decision;
+  decision.probed_threads_ = autotune_probe_;
+  decision.probed_p50_ = p50;
+  decision.switched_ = (p50 < autotune_p50_ * (1.0 - AUTOTUNE_HYSTERESIS));
+  if (decision.switched_) {
+    // keep going the same way next time
+    autotune_threads_ = autotune_probe_;
+    autotune_p50_ = p50;
+  } else {
+    requested_threads_ = autotune_threads_;
+    autotune_skip_ = AUTOTUNE_WARMUP;
+    autotune_direction_ = -autotune_direction_;
+  }
+  decision.num_threads_ = autotune_threads_;
+  decision.p50_ = autotune_p50_;
+  GST_INFO("autotune: %d threads (p50 %.2f ms), probed %d (p50 %.2f ms)",
+    decision.num_threads_, decision.p50_, decision.probed_threads_, decision.probed_p50_);
+  if (autotune_callback_) {
+    autotune_callback_(decision);
+  }
+  autotune_state_ = AUTOTUNE_SETTLE;
+  autotune_count_ = 0;
+}
 
+int tflite_inference_t::set_num_threads(int num_threads)
+{
+  GST_TRACE("%s", __func__);
+
+#ifdef BUILD_WITH_EDGETPU
+  return ERROR;
+#else
+  requested_threads_ = num_threads;
   return OK;
+#endif
+}
+
+int tflite_inference_t::get_num_threads(void)
+{
+#ifdef BUILD_WITH_EDGETPU
+  return ERROR;
+#else
+  return requested_threads_;
+#endif
+}
+
+TfLiteStatus tflite_inference_t::invoke(void)
+{
+  // settings requested since the last run, safe between two Invoke()
+  int num_threads = requested_threads_;
+  if (num_threads_ && (num_threads != num_threads_)) {
+    GST_INFO("SetNumThreads(%d)", num_threads);
+    interpreter_->SetNumThreads(num_threads);
+    num_threads_ = num_threads;
+  }
+
+  // the runtime pool is grown from within Invoke() by this thread, new
+  // pool threads inherit its affinity and scheduling. Threads that already
+  // exist keep the policy of the thread that built the model until the
+  // next model load
+  if (get_thread_policy(&applied_policy_)) {
+    applied_policy_.apply(0);
+  }
+
+  return interpreter_->Invoke();
 }
 
 int tflite_inference_t::get_input_tensor_shape(
@@ -217,3 +412,32 @@ int tflite_inference_t::get_input_tensor(
   *ptr = typed_input_tensor<uint8_t>(0, sz);
   return OK;
 }
+
+int tflite_inference_t::bind_output(
+  const char *name,
+  int index,
+  output_tensor_t& output)
+{
+  GST_TRACE("%s", __func__);
+
+  if (!interpreter_) {
+    return ERROR;
+  }
+  const std::vector<int>& outs = outputs();
+  int tensor = -1;
+  for (size_t i = 0; name && (i < outs.size()); i++) {
+    const char *tensor_name = interpreter_->tensor(outs[i])->name;
+    if (tensor_name && (strcmp(tensor_name, name) == 0)) {
+      tensor = outs[i];
+      break;
+    }
+  }
+  if ((tensor < 0) && (index >= 0) && ((size_t)index < outs.size())) {
+    tensor = outs[index];
+  }
+  if (tensor < 0) {
+    GST_ERROR("No output %s (%d)", name ? name : "", index);
+    return ERROR;
+  }
+  return output.bind(interpreter_->tensor(tensor));
+}
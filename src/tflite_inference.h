@@ -23,6 +23,8 @@
 
 #include "tensorflow/lite/kernels/register.h"
 #include "inference.h"
+#include "output_tensor.h"
+#include <atomic>
 
 class tflite_inference_t : public inference_t
 {
@@ -42,6 +44,12 @@ public:
     int num_threads);
 
   virtual int inference(void);
+  virtual int set_num_threads(int num_threads);
+  virtual int get_num_threads(void);
+  // periodically try the neighbouring thread counts, keep one if its p50
+  // inference time is better by more than the hysteresis
+  virtual int set_autotune(bool enable);
+  virtual void set_autotune_callback(const autotune_callback_t& callback);
   virtual int get_input_tensor_shape(std::vector<int>* shape);
   virtual int get_input_tensor(uint8_t **ptr, size_t* sz);
 
@@ -55,14 +63,7 @@ protected:
     size_t* length = NULL)
   {
     if (length) {
-      *length = 0;
-      TfLiteIntArray *dims = interpreter_->tensor(index)->dims;
-      if (dims && dims->size && dims->data[0]) {
-        *length = 1;
-        for (int i = 0; i < dims->size; i++) {
-          *length *= dims->data[i];
-        }
-      }
+      *length = tensor_length(index);
     }
     return interpreter_->typed_tensor<T>(index);
   }
@@ -73,14 +74,7 @@ protected:
     size_t* length = NULL) const
   {
     if (length) {
-      *length = 0;
-      TfLiteIntArray *dims = interpreter_->tensor(index)->dims;
-      if (dims && dims->size && dims->data[0]) {
-        *length = 1;
-        for (int i = 0; i < dims->size; i++) {
-          *length *= dims->data[i];
-        }
-      }
+      *length = tensor_length(index);
     }
     return interpreter_->typed_tensor<T>(index);
   }
@@ -137,6 +131,18 @@ protected:
     return interpreter_->tensor(interpreter_->outputs()[index])->name;
   }
 
+  // bind the output named name, or else the index-th output, after init()
+  int bind_output(
+    const char *name,
+    int index,
+    output_tensor_t& output);
+
+  // elements of a tensor, from the lengths cached at init()
+  size_t tensor_length(int index) const
+  {
+    return ((size_t)index < tensor_length_.size()) ? tensor_length_[index] : 0;
+  }
+
   std::unique_ptr<tflite::Interpreter> interpreter_;
 
 private:
@@ -144,7 +150,39 @@ private:
   int apply_delegate(
     int use_nnapi);
 
+  // Invoke(), after applying the settings changed since the last run. The
+  // thread policy goes to the calling thread, the runtime threads it spawns
+  // inherit it
+  TfLiteStatus invoke(void);
+
+  void autotune(double inference_time);
+
   std::unique_ptr<tflite::FlatBufferModel> model_;
+  // per tensor index, shapes don't change after AllocateTensors()
+  std::vector<size_t> tensor_length_;
+
+  std::atomic<int> requested_threads_{0};
+  int num_threads_ = 0;
+  thread_policy_t applied_policy_;
+
+  // thread count autotuner, runs in the thread calling inference(). Only
+  // the enable flag and requested_threads_ are shared with other threads,
+  // the callback is set before the first run
+  enum autotune_state_t {
+    AUTOTUNE_MEASURE,
+    AUTOTUNE_PROBE,
+    AUTOTUNE_SETTLE,
+  };
+  std::atomic<bool> autotune_enabled_{false};
+  autotune_callback_t autotune_callback_;
+  autotune_state_t autotune_state_ = AUTOTUNE_MEASURE;
+  std::vector<double> autotune_samples_;
+  int autotune_skip_ = 0;
+  int autotune_count_ = 0;
+  int autotune_threads_ = 0;
+  double autotune_p50_ = 0;
+  int autotune_probe_ = 0;
+  int autotune_direction_ = -1;
 
   // unused
   tflite_inference_t(const tflite_inference_t&);
@@ -0,0 +1,141 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "thread_policy.h"
+#include <gst/gst.h>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY(thread_policy_t_debug);
+#define GST_CAT_DEFAULT thread_policy_t_debug
+
+
+thread_policy_t::thread_policy_t()
+{
+  GST_DEBUG_CATEGORY_INIT(thread_policy_t_debug, "thread_policy_t", 0, "i.MX NN Inference demo thread policy class");
+  CPU_ZERO(&cpus_);
+}
+
+thread_policy_t::~thread_policy_t()
+{
+}
+
+int
+thread_policy_t::set_cpus(const std::string& cpus)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  const char *p = cpus.c_str();
+  while (*p) {
+    char *end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p) {
+      GST_ERROR("invalid CPU list \"%s\"", cpus.c_str());
+      return ERROR;
+    }
+    p = end;
+    if (*p == '-') {
+      p++;
+      last = strtol(p, &end, 10);
+      if (end == p) {
+        GST_ERROR("invalid CPU list \"%s\"", cpus.c_str());
+        return ERROR;
+      }
+      p = end;
+    }
+    if ((first < 0) || (last < first) || (last >= CPU_SETSIZE)) {
+      GST_ERROR("invalid CPU range %ld-%ld", first, last);
+      return ERROR;
+    }
+    for (long i = first; i <= last; i++) {
+      CPU_SET(i, &set);
+    }
+    if (*p == ',') {
+      p++;
+    }
+  }
+
+  has_cpus_ = (CPU_COUNT(&set) > 0);
+  cpus_ = set;
+  return OK;
+}
+
+void
+thread_policy_t::set_all_cpus(void)
+{
+  long count = std::min(sysconf(_SC_NPROCESSORS_CONF), (long)CPU_SETSIZE);
+  CPU_ZERO(&cpus_);
+  for (long i = 0; i < count; i++) {
+    CPU_SET(i, &cpus_);
+  }
+  has_cpus_ = true;
+}
+
+int
+thread_policy_t::set_scheduler(int policy, int priority)
+{
+  if ((policy != SCHED_OTHER) && (policy != SCHED_FIFO) && (policy != SCHED_RR)) {
+    return ERROR;
+  }
+  if (policy != SCHED_OTHER) {
+    int min = sched_get_priority_min(policy);
+    int max = sched_get_priority_max(policy);
+    priority = std::max(min, std::min(max, priority));
+  } else {
+    priority = 0;
+  }
+  has_scheduler_ = true;
+  policy_ = policy;
+  priority_ = priority;
+  return OK;
+}
+
+int
+thread_policy_t::apply(pid_t tid) const
+{
+  int ret = OK;
+
+  if (has_cpus_ && (sched_setaffinity(tid, sizeof(cpus_), &cpus_) != 0)) {
+    GST_WARNING("sched_setaffinity(%d) failed: %s", tid, strerror(errno));
+    ret = ERROR;
+  }
+  if (has_scheduler_) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority_;
+    // real-time policies need CAP_SYS_NICE
+    if (sched_setscheduler(tid, policy_, &param) != 0) {
+      GST_WARNING("sched_setscheduler(%d, %d, %d) failed: %s", tid, policy_, priority_, strerror(errno));
+      ret = ERROR;
+    }
+  }
+  GST_DEBUG("thread %d: %d CPUs, policy %d, priority %d", tid,
+    has_cpus_ ? CPU_COUNT(&cpus_) : -1, policy_, priority_);
+  return ret;
+}
@@ -0,0 +1,62 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef thread_policy_h
+#define thread_policy_h
+
+#include <string>
+#include <sched.h>
+#include <sys/types.h>
+
+// CPU affinity and scheduling policy, applied to threads by thread id.
+// Threads created afterwards by a thread inherit what was applied to it.
+class thread_policy_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  thread_policy_t();
+  virtual ~thread_policy_t();
+
+  // "0-1,3" style CPU list, empty to leave the affinity alone
+  int set_cpus(const std::string& cpus);
+  // every CPU, to undo an earlier set_cpus()
+  void set_all_cpus(void);
+  // SCHED_OTHER, SCHED_FIFO or SCHED_RR, priority is ignored for SCHED_OTHER
+  int set_scheduler(int policy, int priority);
+
+  // tid 0 is the calling thread
+  int apply(pid_t tid) const;
+
+private:
+
+  bool has_cpus_ = false;
+  cpu_set_t cpus_;
+  bool has_scheduler_ = false;
+  int policy_ = SCHED_OTHER;
+  int priority_ = 0;
+
+};
+
+#endif
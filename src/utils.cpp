@@ -19,6 +19,8 @@
  */
 
 #include "utils.h"
+#include <algorithm>
+#include <string.h>
 #ifdef __aarch64__
 #include <arm_neon.h>
 #endif
@@ -62,6 +64,8 @@ bgrx_to_rgb_row(
     src += 32;
     dst += 24;
   }
+#else
+  int num_of_1pix_loop = num_of_pixels;
 #endif
   for (int i = 0; i < num_of_1pix_loop; i++)
   {
@@ -90,4 +94,548 @@ bgrx_to_rgb(
   }
 }
 
+static inline uint8_t
+div255(
+  uint32_t x)
+{
+  // x / 255 for x in [0, 255 * 255], rounded
+  x += 128;
+  return (uint8_t)((x + (x >> 8)) >> 8);
+}
+
+void
+blend_mask_bgrx_row(
+  uint8_t *dst,
+  const uint8_t *mask,
+  int num_of_pixels,
+  const uint8_t color[4])
+{
+#ifdef __aarch64__
+  int num_of_8pix_loop = num_of_pixels >> 3;
+  int num_of_1pix_loop = (num_of_pixels & (8-1));
+
+  uint8x8_t v_color[4];
+  for (int c = 0; c < 4; c++) {
+    v_color[c] = vdup_n_u8(color[c]);
+  }
+  for (int i = 0; i < num_of_8pix_loop; i++)
+  {
+    // load 8 alpha values, skip fully transparent runs (most of a glyph)
+    uint8x8_t v_a = vld1_u8(mask);
+    if (vmaxv_u8(v_a) != 0) {
+      uint8x8_t v_ia = vmvn_u8(v_a);
+      // load 8pixel (32bytes)
+      uint8x8x4_t v_dst = vld4_u8(dst);
+      for (int c = 0; c < 4; c++) {
+        uint16x8_t t = vmull_u8(v_dst.val[c], v_ia);
+        t = vmlal_u8(t, v_color[c], v_a);
+        // t / 255, rounded
+        v_dst.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+      }
+      // store 8pixel (32bytes)
+      vst4_u8(dst, v_dst);
+    }
+    mask += 8;
+    dst += 32;
+  }
+#else
+  int num_of_1pix_loop = num_of_pixels;
+#endif
+  for (int i = 0; i < num_of_1pix_loop; i++)
+  {
+    uint32_t a = mask[0];
+    if (a == 255) {
+      dst[0] = color[0];
+      dst[1] = color[1];
+      dst[2] = color[2];
+      dst[3] = color[3];
+    } else if (a) {
+      uint32_t ia = 255 - a;
+      dst[0] = div255(dst[0] * ia + color[0] * a);
+      dst[1] = div255(dst[1] * ia + color[1] * a);
+      dst[2] = div255(dst[2] * ia + color[2] * a);
+      dst[3] = div255(dst[3] * ia + color[3] * a);
+    }
+    mask += 1;
+    dst += 4;
+  }
+}
+
+
+void
+blend_mask_plane_row(
+  uint8_t *dst,
+  const uint8_t *mask,
+  int num_of_pixels,
+  uint8_t value)
+{
+#ifdef __aarch64__
+  int num_of_8pix_loop = num_of_pixels >> 3;
+  int num_of_1pix_loop = (num_of_pixels & (8-1));
+
+  uint8x8_t v_value = vdup_n_u8(value);
+  for (int i = 0; i < num_of_8pix_loop; i++)
+  {
+    uint8x8_t v_a = vld1_u8(mask);
+    if (vmaxv_u8(v_a) != 0) {
+      uint16x8_t t = vmull_u8(vld1_u8(dst), vmvn_u8(v_a));
+      t = vmlal_u8(t, v_value, v_a);
+      vst1_u8(dst, vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+    }
+    mask += 8;
+    dst += 8;
+  }
+#else
+  int num_of_1pix_loop = num_of_pixels;
+#endif
+  for (int i = 0; i < num_of_1pix_loop; i++)
+  {
+    uint32_t a = mask[0];
+    if (a == 255) {
+      dst[0] = value;
+    } else if (a) {
+      dst[0] = div255(dst[0] * (255 - a) + value * a);
+    }
+    mask += 1;
+    dst += 1;
+  }
+}
+
+void
+blend_mask_uv_row(
+  uint8_t *dst,
+  const uint8_t *mask,
+  int num_of_pixels,
+  const uint8_t uv[2])
+{
+#ifdef __aarch64__
+  int num_of_8pix_loop = num_of_pixels >> 3;
+  int num_of_1pix_loop = (num_of_pixels & (8-1));
+
+  uint8x8_t v_uv[2] = { vdup_n_u8(uv[0]), vdup_n_u8(uv[1]) };
+  for (int i = 0; i < num_of_8pix_loop; i++)
+  {
+    uint8x8_t v_a = vld1_u8(mask);
+    if (vmaxv_u8(v_a) != 0) {
+      uint8x8_t v_ia = vmvn_u8(v_a);
+      // load 8 UV pairs (16bytes)
+      uint8x8x2_t v_dst = vld2_u8(dst);
+      for (int c = 0; c < 2; c++) {
+        uint16x8_t t = vmull_u8(v_dst.val[c], v_ia);
+        t = vmlal_u8(t, v_uv[c], v_a);
+        v_dst.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+      }
+      vst2_u8(dst, v_dst);
+    }
+    mask += 8;
+    dst += 16;
+  }
+#else
+  int num_of_1pix_loop = num_of_pixels;
+#endif
+  for (int i = 0; i < num_of_1pix_loop; i++)
+  {
+    uint32_t a = mask[0];
+    if (a == 255) {
+      dst[0] = uv[0];
+      dst[1] = uv[1];
+    } else if (a) {
+      uint32_t ia = 255 - a;
+      dst[0] = div255(dst[0] * ia + uv[0] * a);
+      dst[1] = div255(dst[1] * ia + uv[1] * a);
+    }
+    mask += 1;
+    dst += 2;
+  }
+}
+
+static inline void
+copy_row_nt(
+  uint8_t *dst,
+  const uint8_t *src,
+  int num_of_bytes)
+{
+#ifdef __aarch64__
+  // align dst to 16 bytes first
+  int head = (int)((16 - ((uintptr_t)dst & 15)) & 15);
+  if (head > num_of_bytes) {
+    head = num_of_bytes;
+  }
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  num_of_bytes -= head;
+
+  int num_of_64byte_loop = num_of_bytes >> 6;
+  for (int i = 0; i < num_of_64byte_loop; i++)
+  {
+    // load 64bytes, store them without allocating cache lines
+    asm volatile(
+      "ldp q0, q1, [%1]\n"
+      "ldp q2, q3, [%1, #32]\n"
+      "stnp q0, q1, [%0]\n"
+      "stnp q2, q3, [%0, #32]\n"
+      :
+      : "r" (dst), "r" (src)
+      : "v0", "v1", "v2", "v3", "memory");
+    src += 64;
+    dst += 64;
+  }
+  memcpy(dst, src, num_of_bytes & (64-1));
+#else
+  memcpy(dst, src, num_of_bytes);
+#endif
+}
+
+void
+copy_plane(
+  uint8_t *dst,
+  int dst_stride,
+  const uint8_t *src,
+  int src_stride,
+  int row_bytes,
+  int rows)
+{
+  if ((dst_stride == row_bytes) && (src_stride == row_bytes)) {
+    // contiguous, copy as a single row
+    row_bytes *= rows;
+    rows = 1;
+  }
+  for (int row = 0; row < rows; row++)
+  {
+    copy_row_nt(dst, src, row_bytes);
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void
+blend_bgra_premul_row(
+  uint8_t *dst,
+  const uint8_t *src,
+  int num_of_pixels)
+{
+#ifdef __aarch64__
+  int num_of_8pix_loop = num_of_pixels >> 3;
+  int num_of_1pix_loop = (num_of_pixels & (8-1));
+
+  for (int i = 0; i < num_of_8pix_loop; i++)
+  {
+    // load 8pixel (32bytes), skip fully transparent runs
+    uint8x8x4_t v_src = vld4_u8(src);
+    if (vmaxv_u8(v_src.val[3]) != 0) {
+      uint8x8_t v_ia = vmvn_u8(v_src.val[3]);
+      uint8x8x4_t v_dst = vld4_u8(dst);
+      for (int c = 0; c < 4; c++) {
+        uint16x8_t t = vmull_u8(v_dst.val[c], v_ia);
+        // src + t / 255, rounded
+        v_dst.val[c] = vqadd_u8(v_src.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+      }
+      vst4_u8(dst, v_dst);
+    }
+    src += 32;
+    dst += 32;
+  }
+#else
+  int num_of_1pix_loop = num_of_pixels;
+#endif
+  for (int i = 0; i < num_of_1pix_loop; i++)
+  {
+    uint32_t a = src[3];
+    if (a == 255) {
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+      dst[3] = src[3];
+    } else if (a) {
+      uint32_t ia = 255 - a;
+      dst[0] = std::min(255, src[0] + div255(dst[0] * ia));
+      dst[1] = std::min(255, src[1] + div255(dst[1] * ia));
+      dst[2] = std::min(255, src[2] + div255(dst[2] * ia));
+      dst[3] = std::min(255, src[3] + div255(dst[3] * ia));
+    }
+    src += 4;
+    dst += 4;
+  }
+}
+
+template <typename T>
+static inline int
+top_k_insert(
+  const T *data,
+  int i,
+  int k,
+  int *indices,
+  int count)
+{
+  // indices[0..count) is sorted by value, largest first
+  T value = data[i];
+  int pos = count;
+  if (count == k) {
+    if (value <= data[indices[k - 1]]) {
+      return count;
+    }
+    pos = k - 1; // evict the smallest
+  } else {
+    count++;
+  }
+  while ((pos > 0) && (data[indices[pos - 1]] < value)) {
+    indices[pos] = indices[pos - 1];
+    pos--;
+  }
+  indices[pos] = i;
+  return count;
+}
+
+template <typename T>
+static inline int
+top_k_range(
+  const T *data,
+  int begin,
+  int end,
+  int k,
+  int *indices,
+  int count)
+{
+  for (int i = begin; i < end; i++) {
+    count = top_k_insert(data, i, k, indices, count);
+  }
+  return count;
+}
+
+int
+top_k_u8(
+  const uint8_t *data,
+  int n,
+  int k,
+  int *indices)
+{
+  if (k <= 0) {
+    return 0;
+  }
+  int count = 0;
+  int i = 0;
+#ifdef __aarch64__
+  for (; i + 16 <= n; i += 16)
+  {
+    // once full, only blocks above the k-th value need a scalar pass
+    if ((count == k) && (vmaxvq_u8(vld1q_u8(data + i)) <= data[indices[k - 1]])) {
+      continue;
+    }
+    count = top_k_range(data, i, i + 16, k, indices, count);
+  }
+#endif
+  return top_k_range(data, i, n, k, indices, count);
+}
+
+int
+top_k_s8(
+  const int8_t *data,
+  int n,
+  int k,
+  int *indices)
+{
+  if (k <= 0) {
+    return 0;
+  }
+  int count = 0;
+  int i = 0;
+#ifdef __aarch64__
+  for (; i + 16 <= n; i += 16)
+  {
+    if ((count == k) && (vmaxvq_s8(vld1q_s8(data + i)) <= data[indices[k - 1]])) {
+      continue;
+    }
+    count = top_k_range(data, i, i + 16, k, indices, count);
+  }
+#endif
+  return top_k_range(data, i, n, k, indices, count);
+}
+
+int
+top_k_f32(
+  const float *data,
+  int n,
+  int k,
+  int *indices)
+{
+  if (k <= 0) {
+    return 0;
+  }
+  int count = 0;
+  int i = 0;
+#ifdef __aarch64__
+  for (; i + 16 <= n; i += 16)
+  {
+    if (count == k) {
+      float32x4_t v_max = vmaxq_f32(
+        vmaxq_f32(vld1q_f32(data + i), vld1q_f32(data + i + 4)),
+        vmaxq_f32(vld1q_f32(data + i + 8), vld1q_f32(data + i + 12)));
+      if (vmaxvq_f32(v_max) <= data[indices[k - 1]]) {
+        continue;
+      }
+    }
+    count = top_k_range(data, i, i + 16, k, indices, count);
+  }
+#endif
+  return top_k_range(data, i, n, k, indices, count);
+}
+
+template <typename T>
+static inline uint8_t
+argmax_find(
+  const T *data,
+  int num_channels,
+  int first,
+  T max)
+{
+  // scalar tail, then the first channel holding the max
+  for (int c = first; c < num_channels; c++) {
+    if (data[c] > max) {
+      max = data[c];
+    }
+  }
+  int c = 0;
+  while ((c < num_channels - 1) && !(data[c] == max)) {
+    c++;
+  }
+  return (uint8_t)c;
+}
+
+void
+argmax_u8(
+  const uint8_t *data,
+  int num_pixels,
+  int num_channels,
+  uint8_t *index)
+{
+  for (int i = 0; i < num_pixels; i++)
+  {
+    int c = 1;
+    uint8_t max = data[0];
+#ifdef __aarch64__
+    if (num_channels >= 16) {
+      uint8x16_t v_max = vld1q_u8(data);
+      for (c = 16; c + 16 <= num_channels; c += 16) {
+        v_max = vmaxq_u8(v_max, vld1q_u8(data + c));
+      }
+      max = vmaxvq_u8(v_max);
+    }
+#endif
+    index[i] = argmax_find(data, num_channels, c, max);
+    data += num_channels;
+  }
+}
+
+void
+argmax_s8(
+  const int8_t *data,
+  int num_pixels,
+  int num_channels,
+  uint8_t *index)
+{
+  for (int i = 0; i < num_pixels; i++)
+  {
+    int c = 1;
+    int8_t max = data[0];
+#ifdef __aarch64__
+    if (num_channels >= 16) {
+      int8x16_t v_max = vld1q_s8(data);
+      for (c = 16; c + 16 <= num_channels; c += 16) {
+        v_max = vmaxq_s8(v_max, vld1q_s8(data + c));
+      }
+      max = vmaxvq_s8(v_max);
+    }
+#endif
+    index[i] = argmax_find(data, num_channels, c, max);
+    data += num_channels;
+  }
+}
+
+void
+argmax_f32(
+  const float *data,
+  int num_pixels,
+  int num_channels,
+  uint8_t *index)
+{
+  for (int i = 0; i < num_pixels; i++)
+  {
+    int c = 1;
+    float max = data[0];
+#ifdef __aarch64__
+    if (num_channels >= 4) {
+      float32x4_t v_max = vld1q_f32(data);
+      for (c = 4; c + 4 <= num_channels; c += 4) {
+        v_max = vmaxq_f32(v_max, vld1q_f32(data + c));
+      }
+      max = vmaxvq_f32(v_max);
+    }
+#endif
+    index[i] = argmax_find(data, num_channels, c, max);
+    data += num_channels;
+  }
+}
+
+void
+dequantize_u8(
+  const uint8_t *src,
+  float *dst,
+  int n,
+  float scale,
+  int zero_point)
+{
+#ifdef __aarch64__
+  int num_of_8_loop = n >> 3;
+  int num_of_1_loop = n & (8-1);
+  int16x8_t v_zero_point = vdupq_n_s16(zero_point);
+
+  for (int i = 0; i < num_of_8_loop; i++)
+  {
+    // widen to 16bit, remove the zero point, widen to 32bit
+    int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(src))), v_zero_point);
+    vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+    vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    src += 8;
+    dst += 8;
+  }
+#else
+  int num_of_1_loop = n;
+#endif
+  for (int i = 0; i < num_of_1_loop; i++)
+  {
+    *dst++ = scale * (*src++ - zero_point);
+  }
+}
+
+void
+dequantize_s8(
+  const int8_t *src,
+  float *dst,
+  int n,
+  float scale,
+  int zero_point)
+{
+#ifdef __aarch64__
+  int num_of_8_loop = n >> 3;
+  int num_of_1_loop = n & (8-1);
+  int16x8_t v_zero_point = vdupq_n_s16(zero_point);
+
+  for (int i = 0; i < num_of_8_loop; i++)
+  {
+    int16x8_t v = vsubq_s16(vmovl_s8(vld1_s8(src)), v_zero_point);
+    vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+    vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    src += 8;
+    dst += 8;
+  }
+#else
+  int num_of_1_loop = n;
+#endif
+  for (int i = 0; i < num_of_1_loop; i++)
+  {
+    *dst++ = scale * (*src++ - zero_point);
+  }
+}
+
 }
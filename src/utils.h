@@ -37,6 +37,99 @@ namespace utils {
     int height,  // pixel
     int stride); // pixel
 
+  // alpha blend a solid color into BGRx pixels through an 8bit mask
+  void blend_mask_bgrx_row(
+    uint8_t *dst,
+    const uint8_t *mask,
+    int num_of_pixels,
+    const uint8_t color[4]); // B, G, R, X
+
+  // alpha blend a constant value into an 8bit plane through an 8bit mask
+  void blend_mask_plane_row(
+    uint8_t *dst,
+    const uint8_t *mask,
+    int num_of_pixels,
+    uint8_t value);
+
+  // same as blend_mask_plane_row, for interleaved UV (NV12 chroma)
+  void blend_mask_uv_row(
+    uint8_t *dst,
+    const uint8_t *mask,
+    int num_of_pixels,
+    const uint8_t uv[2]); // U, V
+
+  // copy rows of row_bytes between strided planes, with non-temporal
+  // stores, the destination is not read back by the CPU
+  void copy_plane(
+    uint8_t *dst,
+    int dst_stride, // bytes
+    const uint8_t *src,
+    int src_stride, // bytes
+    int row_bytes,
+    int rows);
+
+  // composite premultiplied BGRA pixels over BGRx pixels
+  void blend_bgra_premul_row(
+    uint8_t *dst,
+    const uint8_t *src,
+    int num_of_pixels);
+
+  // indices of the k largest values, largest first, returns how many
+  // were found (min(k, n)), blocks that cannot enter the current top-k
+  // are rejected with a single SIMD max
+  int top_k_u8(
+    const uint8_t *data,
+    int n,
+    int k,
+    int *indices);
+
+  int top_k_s8(
+    const int8_t *data,
+    int n,
+    int k,
+    int *indices);
+
+  int top_k_f32(
+    const float *data,
+    int n,
+    int k,
+    int *indices);
+
+  // per pixel index of the largest of num_channels interleaved values
+  // (first one on ties), num_channels <= 256
+  void argmax_u8(
+    const uint8_t *data,
+    int num_pixels,
+    int num_channels,
+    uint8_t *index);
+
+  void argmax_s8(
+    const int8_t *data,
+    int num_pixels,
+    int num_channels,
+    uint8_t *index);
+
+  void argmax_f32(
+    const float *data,
+    int num_pixels,
+    int num_channels,
+    uint8_t *index);
+
+  // dst[i] = scale * (src[i] - zero_point)
+  void dequantize_u8(
+    const uint8_t *src,
+    float *dst,
+    int n,
+    float scale,
+    int zero_point);
+
+  void dequantize_s8(
+    const int8_t *src,
+    float *dst,
+    int n,
+    float scale,
+    int zero_point);
+
 }
 
 #endif
@@ -0,0 +1,232 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "worker_pool.h"
+#include <gst/gst.h>
+#include <algorithm>
+
+GST_DEBUG_CATEGORY(worker_pool_t_debug);
+#define GST_CAT_DEFAULT worker_pool_t_debug
+
+// a parallel_for() is split in at most this many chunks per thread, for
+// balance when some threads are busy elsewhere
+#define CHUNKS_PER_THREAD (4)
+
+// pool and queue index of the worker threads
+static thread_local const worker_pool_t *current_pool = NULL;
+static thread_local int current_index = -1;
+
+
+worker_pool_t::worker_pool_t(int num_threads)
+{
+  GST_DEBUG_CATEGORY_INIT(worker_pool_t_debug, "worker_pool_t", 0, "i.MX NN Inference demo worker pool class");
+  GST_TRACE("%s", __func__);
+
+  num_threads = std::max(num_threads, 0);
+  for (int i = 0; i <= num_threads; i++) {
+    queues_.emplace_back(new queue_t());
+  }
+  for (int i = 0; i < num_threads; i++) {
+    threads_.emplace_back(&worker_pool_t::worker, this, i);
+  }
+  GST_DEBUG("%d worker threads", num_threads);
+}
+
+worker_pool_t::~worker_pool_t()
+{
+  GST_TRACE("%s", __func__);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++) {
+    threads_[i].join();
+  }
+}
+
+std::shared_ptr<worker_pool_t>
+worker_pool_t::shared(int num_threads)
+{
+  static std::mutex shared_mutex;
+  static std::weak_ptr<worker_pool_t> shared_pool;
+
+  std::lock_guard<std::mutex> lock(shared_mutex);
+  std::shared_ptr<worker_pool_t> pool = shared_pool.lock();
+  if (!pool || (pool->num_threads() != std::max(num_threads, 0))) {
+    pool.reset(new worker_pool_t(num_threads));
+    shared_pool = pool;
+  }
+  return pool;
+}
+
+void
+worker_pool_t::set_thread_policy(const thread_policy_t& policy)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_policy_ = policy;
+    policy_generation_++;
+  }
+  cond_.notify_all();
+}
+
+int
+worker_pool_t::queue_index(void) const
+{
+  return (current_pool == this) ? current_index : (int)threads_.size();
+}
+
+bool
+worker_pool_t::run_one(int index)
+{
+  task_t task;
+  bool found = false;
+
+  // own queue from the back, the most recent slices are the nested ones
+  {
+    queue_t& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    if (!queue.tasks_.empty()) {
+      task = queue.tasks_.back();
+      queue.tasks_.pop_back();
+      found = true;
+    }
+  }
+  // then steal the oldest slices of the others
+  for (size_t i = 1; !found && (i < queues_.size()); i++) {
+    queue_t& queue = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    if (!queue.tasks_.empty()) {
+      task = queue.tasks_.front();
+      queue.tasks_.pop_front();
+      found = true;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  queued_--;
+
+  (*task.job_)(task.index_);
+  if (--(*task.pending_) == 0) {
+    // the owner may be about to wait
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_all();
+  }
+  return true;
+}
+
+void
+worker_pool_t::worker(int index)
+{
+  unsigned policy_generation = 0;
+
+  current_pool = this;
+  current_index = index;
+  for (;;) {
+    thread_policy_t policy;
+    bool apply_policy = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [&] {
+        return stop_ || (queued_ > 0) || (policy_generation != policy_generation_);
+      });
+      if (stop_) {
+        return;
+      }
+      if (policy_generation != policy_generation_) {
+        policy = thread_policy_;
+        policy_generation = policy_generation_;
+        apply_policy = true;
+      }
+    }
+    if (apply_policy && (policy.apply(0) != thread_policy_t::OK)) {
+      GST_WARNING("failed to apply thread policy to worker %d", index);
+    }
+    while (run_one(index)) {
+    }
+  }
+}
+
+void
+worker_pool_t::run(
+  int num_jobs,
+  const std::function<void(int)>& job)
+{
+  if (num_jobs <= 0) {
+    return;
+  }
+  if (threads_.empty() || (num_jobs == 1)) {
+    for (int i = 0; i < num_jobs; i++) {
+      job(i);
+    }
+    return;
+  }
+
+  std::atomic<int> pending{num_jobs};
+  int index = queue_index();
+  {
+    // the caller starts from the first slice, thieves take the last ones
+    queue_t& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    for (int i = 0; i < num_jobs; i++) {
+      queue.tasks_.push_back(task_t{&job, num_jobs - 1 - i, &pending});
+    }
+    queued_ += num_jobs;
+  }
+  // waiters check queued_ under mutex_, don't notify in between
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  cond_.notify_all();
+
+  // help until our slices are done, with whatever is queued
+  while (pending > 0) {
+    if (run_one(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&] { return (pending == 0) || (queued_ > 0); });
+  }
+}
+
+void
+worker_pool_t::parallel_for(
+  int n,
+  int grain,
+  const std::function<void(int, int)>& body)
+{
+  if (n <= 0) {
+    return;
+  }
+  grain = std::max(grain, 1);
+  int num_chunks = std::min((n + grain - 1) / grain,
+      (num_threads() + 1) * CHUNKS_PER_THREAD);
+  run(num_chunks, [&](int chunk) {
+    body((int)((long long)n * chunk / num_chunks),
+        (int)((long long)n * (chunk + 1) / num_chunks));
+  });
+}
@@ -0,0 +1,111 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef worker_pool_h
+#define worker_pool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "thread_policy.h"
+
+// Work-stealing pool of worker threads.
+// run() splits a job into num_jobs slices and blocks until all are done.
+// Slices go to the queue of the calling thread, workers take from the back
+// of their own queue and steal from the front of the others. Threads
+// waiting for their slices run queued slices meanwhile, so run() can be
+// nested from a slice and called from several threads at once.
+class worker_pool_t
+{
+public:
+
+  enum {
+    OK = 0,
+    ERROR = -1,
+  };
+
+  // num_threads workers in addition to the calling thread
+  explicit worker_pool_t(int num_threads);
+  virtual ~worker_pool_t();
+
+  int num_threads() const { return (int)threads_.size(); }
+
+  // calls job(i) for i in [0, num_jobs)
+  void run(
+    int num_jobs,
+    const std::function<void(int)>& job);
+
+  // calls body(begin, end) over [0, n), in chunks of at least grain
+  void parallel_for(
+    int n,
+    int grain,
+    const std::function<void(int, int)>& body);
+
+  // taken by each worker before its next slice
+  void set_thread_policy(const thread_policy_t& policy);
+
+  // pool shared by the whole process. A new one is made when num_threads
+  // changes, holders of the previous one keep it until they let it go
+  static std::shared_ptr<worker_pool_t> shared(int num_threads);
+
+private:
+
+  // slice i of a job, pending counts the slices of the job not done yet
+  struct task_t {
+    const std::function<void(int)> *job_;
+    int index_;
+    std::atomic<int> *pending_;
+  };
+  struct queue_t {
+    std::mutex mutex_;
+    std::deque<task_t> tasks_;
+  };
+
+  void worker(int index);
+  // queue of the calling thread, the last one for threads outside the pool
+  int queue_index(void) const;
+  // runs one queued slice, own queue first, false if there was none
+  bool run_one(int index);
+
+  std::vector<std::thread> threads_;
+  // one per worker, plus one for the other threads
+  std::vector<std::unique_ptr<queue_t>> queues_;
+  std::atomic<int> queued_{0};
+
+  // sleeping workers and waiting callers
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_ = false;
+  // guarded by mutex_
+  thread_policy_t thread_policy_;
+  unsigned policy_generation_ = 0;
+
+  // unused
+  worker_pool_t(const worker_pool_t&);
+  worker_pool_t& operator=(const worker_pool_t&);
+
+};
+
+#endif
@@ -0,0 +1,195 @@
+/* GStreamer i.MX NN Inference demo plugin
+ *
+ * Copyright 2021 NXP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* phy_addr_from_fd_cached() with phy_addr_from_fd() stubbed: regular files
+ * stand for the dmabufs, each lookup that reaches the stub gets a new
+ * address, so a cached address is one seen before */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "gstimx.h"
+
+/* PHY_ADDR_CACHE_SIZE */
+#define CACHE_SIZE (32)
+
+static int lookups;
+static unsigned long expected_hits;
+static unsigned long expected_misses;
+static int failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+unsigned long
+phy_addr_from_fd (int dmafd)
+{
+  if (dmafd < 0)
+    return 0;
+  lookups++;
+  return 0x10000000UL + lookups * 0x1000UL;
+}
+
+/* an fd with an inode of its own */
+static int
+open_file (void)
+{
+  char path[] = "/tmp/phy_addr_cache_XXXXXX";
+  int fd = mkstemp (path);
+
+  if (fd < 0) {
+    perror ("mkstemp");
+    exit (1);
+  }
+  unlink (path);
+  return fd;
+}
+
+/* cached lookup of fd, expected to hit or to reach the stub */
+static unsigned long
+lookup (int fd, int hit)
+{
+  int before = lookups;
+  unsigned long paddr = phy_addr_from_fd_cached (fd);
+
+  if (hit) {
+    expected_hits++;
+    CHECK (lookups == before);
+  } else {
+    expected_misses++;
+    CHECK (lookups == before + 1);
+  }
+  CHECK (paddr != 0);
+  return paddr;
+}
+
+static void
+check_stats (void)
+{
+  unsigned long hits, misses;
+
+  phy_addr_cache_get_stats (&hits, &misses);
+  CHECK (hits == expected_hits);
+  CHECK (misses == expected_misses);
+}
+
+static void
+test_repeated_fd (void)
+{
+  int fd = open_file ();
+  unsigned long paddr = lookup (fd, 0);
+
+  CHECK (lookup (fd, 1) == paddr);
+  CHECK (lookup (fd, 1) == paddr);
+  check_stats ();
+  close (fd);
+  phy_addr_cache_invalidate (-1);
+}
+
+/* the fd number alone doesn't identify the buffer: the first file is kept
+ * open through a dup so that the reused fd can't get its inode back */
+static void
+test_reused_fd (void)
+{
+  int fd = open_file ();
+  unsigned long paddr = lookup (fd, 0);
+  int held = dup (fd);
+  int reused;
+
+  close (fd);
+  reused = open_file ();
+  CHECK (reused == fd);
+  CHECK (lookup (reused, 0) != paddr);
+  check_stats ();
+  close (reused);
+  close (held);
+  phy_addr_cache_invalidate (-1);
+}
+
+static void
+test_invalidate (void)
+{
+  int fd = open_file ();
+  int other = open_file ();
+
+  lookup (fd, 0);
+  lookup (other, 0);
+  phy_addr_cache_invalidate (fd);
+  lookup (fd, 0);
+  lookup (other, 1);
+
+  phy_addr_cache_invalidate (-1);
+  lookup (fd, 0);
+  lookup (other, 0);
+  check_stats ();
+  close (fd);
+  close (other);
+  phy_addr_cache_invalidate (-1);
+}
+
+static void
+test_lru (void)
+{
+  int fds[CACHE_SIZE + 1];
+  int i;
+
+  for (i = 0; i <= CACHE_SIZE; i++)
+    fds[i] = open_file ();
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    lookup (fds[i], 0);
+  /* fds[1] is now the least recently used */
+  lookup (fds[0], 1);
+  lookup (fds[CACHE_SIZE], 0);
+
+  lookup (fds[0], 1);
+  lookup (fds[CACHE_SIZE], 1);
+  for (i = 2; i < CACHE_SIZE; i++)
+    lookup (fds[i], 1);
+  lookup (fds[1], 0);
+  check_stats ();
+
+  for (i = 0; i <= CACHE_SIZE; i++)
+    close (fds[i]);
+  phy_addr_cache_invalidate (-1);
+}
+
+int
+main (int argc, char *argv[])
+{
+  CHECK (phy_addr_from_fd_cached (-1) == 0);
+  check_stats ();
+
+  test_repeated_fd ();
+  test_reused_fd ();
+  test_invalidate ();
+  test_lru ();
+
+  if (failures) {
+    fprintf (stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}